@@ -0,0 +1,521 @@
+/* act.c - FSM state and actions the backends have in common, for fsm_*_*
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_BACK_ACT
+
+#include "act.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vt.h"
+#include "../common/arena.h"
+#include "../common/common.h"
+#include "../common/log.h"
+
+#define OUTBUFSZ 4096
+#define PS1BUFSZ 256
+#define ARENAKEEP (256 * 1024) /* most we hold on to between commands */
+#define NUMPEND 64 /* max escape seqs between output and prompt */
+
+/* the screen we're rendering output on, must match the terminal size that
+ * sc reports to the switch */
+#define VTROWS 9999
+#define VTCOLS 130
+
+
+/* per-instance state of the init FSM, its ctx */
+struct init {
+	fsm *fsm;           /* the actual state machine */
+	act_mktok_fn f_mktok;
+	struct ansiseq seq; /* most recent escape sequence token */
+	bool bol;           /* at the start of a line, see act_mktok_fn */
+
+	char *ps1buf; /* hold prompt */
+	size_t ps1bufsz, ps1bufcnt;
+
+	bool anykey; /* flag - the any key has to be pressed */
+	bool report; /* flag - cursor position^W^Wterminal size report */
+};
+
+/* per-instance state of the cmdout FSM, its ctx */
+struct cmdout {
+	fsm *fsm;           /* the actual state machine */
+	act_mktok_fn f_mktok;
+	struct ansiseq seq; /* most recent escape sequence token */
+	bool bol;           /* at the start of a line, see act_mktok_fn */
+
+	arena *arena; /* backs the buffers below, reset per command */
+
+	bool more; /* flag - the pager wants a keypress */
+
+	vt *vt; /* output is rendered here, then emitted to outbuf */
+
+	/* Escape seqs seen after the output.  Until we're done we can't tell
+	 * the prompt from more output, so we keep these, along with what might
+	 * be the prompt (in ps1buf), to replay them on the screen if need be.
+	 * The first `npre` of them precede ps1buf, the rest follow it. */
+	struct ansiseq pend[NUMPEND];
+	size_t npend, npre;
+
+	char *outbuf, *ps1buf; /* hold output and prompt respectively */
+	size_t outbufsz, ps1bufsz, outbufcnt, ps1bufcnt;
+};
+
+/* per-instance state of the inchar FSM, its ctx */
+struct inchar {
+	fsm *fsm;           /* the actual state machine */
+	act_mktok_fn f_mktok;
+	struct ansiseq seq; /* most recent escape sequence token */
+	bool bol;           /* at the start of a line, see act_mktok_fn */
+};
+
+
+static void init_reset(void *ctx);
+static int init_mktok(void *ctx, const uint8_t *in, size_t len,
+                      size_t *toklen);
+static void init_destroy(fsm *f);
+static const char *init_ps1buf(fsm *f);
+static size_t init_ps1bufcnt(fsm *f);
+static bool init_anykey(fsm *f);
+static bool init_report(fsm *f);
+static void cmdout_reset(void *ctx);
+static int cmdout_mktok(void *ctx, const uint8_t *in, size_t len,
+                        size_t *toklen);
+static void demote(struct cmdout *h);
+static void emit(void *ctx, const char *data, size_t len);
+static void cmdout_destroy(fsm *f);
+static const char *cmdout_ps1buf(fsm *f);
+static size_t cmdout_ps1bufcnt(fsm *f);
+static const char *cmdout_outbuf(fsm *f);
+static size_t cmdout_outbufcnt(fsm *f);
+static void cmdout_outdrop(fsm *f, size_t n);
+static bool cmdout_more(fsm *f);
+static void inchar_reset(void *ctx);
+static int inchar_mktok(void *ctx, const uint8_t *in, size_t len,
+                        size_t *toklen);
+static void inchar_destroy(fsm *f);
+
+
+fsm *
+act_init_new(size_t nsta, size_t ntok, int errst, int inist, int *accst,
+             size_t naccst, struct fsm_trans *delta, act_mktok_fn f_mktok)
+{
+	struct init *h = xmalloc(sizeof *h);
+	h->fsm = fsm_new(nsta, ntok, errst, inist, accst, naccst, delta,
+	                 init_mktok, init_reset, h);
+	h->f_mktok = f_mktok;
+	(h->ps1buf = xmalloc(h->ps1bufsz = PS1BUFSZ))[0] = '\0';
+	init_reset(h);
+	return h->fsm;
+}
+
+void
+act_init_attach(struct fsm_init_if *ifc)
+{
+	ifc->f_destroy = init_destroy;
+	ifc->f_ps1buf = init_ps1buf;
+	ifc->f_ps1bufcnt = init_ps1bufcnt;
+	ifc->f_anykey = init_anykey;
+	ifc->f_report = init_report;
+	return;
+}
+
+void
+act_ak(void *ctx, int c)
+{
+	(void)c;
+	((struct init *)ctx)->anykey = true;
+	return;
+}
+
+void
+act_report(void *ctx, int c)
+{
+	(void)c;
+	((struct init *)ctx)->report = true;
+	return;
+}
+
+/* record this character to PS1 buffer */
+void
+act_initps(void *ctx, int c)
+{
+	struct init *h = ctx;
+	if ((h->ps1bufcnt+1) >= h->ps1bufsz)
+		h->ps1buf = xrealloc(h->ps1buf, h->ps1bufsz *= 2);
+
+	h->ps1buf[h->ps1bufcnt++] = c;
+	h->ps1buf[h->ps1bufcnt] = '\0';
+	return;
+}
+
+fsm *
+act_cmdout_new(size_t nsta, size_t ntok, int errst, int inist, int *accst,
+               size_t naccst, struct fsm_trans *delta, act_mktok_fn f_mktok)
+{
+	struct cmdout *h = xmalloc(sizeof *h);
+	h->fsm = fsm_new(nsta, ntok, errst, inist, accst, naccst, delta,
+	                 cmdout_mktok, cmdout_reset, h);
+	h->f_mktok = f_mktok;
+	h->arena = arena_new(PS1BUFSZ + OUTBUFSZ, ARENAKEEP);
+	h->vt = vt_new(VTROWS, VTCOLS, emit, h);
+	cmdout_reset(h);
+	return h->fsm;
+}
+
+void
+act_cmdout_attach(struct fsm_cmdout_if *ifc)
+{
+	ifc->f_destroy = cmdout_destroy;
+	ifc->f_ps1buf = cmdout_ps1buf;
+	ifc->f_ps1bufcnt = cmdout_ps1bufcnt;
+	ifc->f_outbuf = cmdout_outbuf;
+	ifc->f_outbufcnt = cmdout_outbufcnt;
+	ifc->f_outdrop = cmdout_outdrop;
+	ifc->f_more = cmdout_more;
+	return;
+}
+
+/* put this character on the screen */
+void
+act_rec(void *ctx, int c)
+{
+	vt_putc(((struct cmdout *)ctx)->vt, c);
+	return;
+}
+
+/* apply this escape sequence to the screen */
+void
+act_seq(void *ctx, int c)
+{
+	(void)c;
+	struct cmdout *h = ctx;
+	vt_seq(h->vt, &h->seq);
+	return;
+}
+
+/* hold on to this escape sequence until we know what it belongs to */
+void
+act_pend(void *ctx, int c)
+{
+	(void)c;
+	struct cmdout *h = ctx;
+	if (h->npend == NUMPEND) {
+		W("too many escape sequences after the output, dropping");
+		return;
+	}
+
+	h->pend[h->npend++] = h->seq;
+	return;
+}
+
+/* record this character to PS1 buffer */
+void
+act_recps(void *ctx, int c)
+{
+	struct cmdout *h = ctx;
+	if (!h->ps1bufcnt)
+		h->npre = h->npend;
+
+	if ((h->ps1bufcnt+1) >= h->ps1bufsz) {
+		h->ps1buf = arena_grow(h->arena, h->ps1buf, h->ps1bufsz,
+		                       h->ps1bufsz * 2);
+		h->ps1bufsz *= 2;
+	}
+
+	h->ps1buf[h->ps1bufcnt++] = c;
+	h->ps1buf[h->ps1bufcnt] = '\0';
+	return;
+}
+
+/* what we've got in ps1buf was output after all, and here's more */
+void
+act_demote(void *ctx, int c)
+{
+	demote(ctx);
+	act_recps(ctx, c);
+	return;
+}
+
+/* the pager interrupted the output */
+void
+act_more(void *ctx, int c)
+{
+	(void)c;
+	D("pager prompt seen");
+	((struct cmdout *)ctx)->more = true;
+	return;
+}
+
+/* the pager interrupted what we thought might have been the prompt */
+void
+act_demore(void *ctx, int c)
+{
+	demote(ctx);
+	act_more(ctx, c);
+	return;
+}
+
+/* done, we have a question, or just a PS1 change but no real output */
+void
+act_noout(void *ctx, int c)
+{
+	(void)c;
+	struct cmdout *h = ctx;
+	vt_flush(h->vt);
+
+	/* what we recorded as output is the prompt; swap, don't copy */
+	char *buf = h->ps1buf;
+	size_t bufsz = h->ps1bufsz;
+
+	h->ps1buf = h->outbuf;
+	h->ps1bufsz = h->outbufsz;
+	h->ps1bufcnt = h->outbufcnt;
+
+	h->outbuf = buf;
+	h->outbufsz = bufsz;
+	h->outbufcnt = 0;
+	h->outbuf[0] = '\0';
+	return;
+}
+
+/* done, we have output and a prompt */
+void
+act_fin(void *ctx, int c)
+{
+	(void)c;
+	vt_flush(((struct cmdout *)ctx)->vt);
+	return;
+}
+
+fsm *
+act_inchar_new(size_t nsta, size_t ntok, int errst, int inist, int *accst,
+               size_t naccst, struct fsm_trans *delta, act_mktok_fn f_mktok)
+{
+	struct inchar *h = xmalloc(sizeof *h);
+	h->fsm = fsm_new(nsta, ntok, errst, inist, accst, naccst, delta,
+	                 inchar_mktok, inchar_reset, h);
+	h->f_mktok = f_mktok;
+	inchar_reset(h);
+	return h->fsm;
+}
+
+void
+act_inchar_attach(struct fsm_inchar_if *ifc)
+{
+	ifc->f_destroy = inchar_destroy;
+	return;
+}
+
+
+
+static void
+init_reset(void *ctx)
+{
+	struct init *h = ctx;
+	h->ps1bufcnt = 0;
+	h->ps1buf[0] = '\0';
+	h->anykey = false;
+	h->report = false;
+	h->bol = true;
+	return;
+}
+
+static int
+init_mktok(void *ctx, const uint8_t *in, size_t len, size_t *toklen)
+{
+	struct init *h = ctx;
+	return h->f_mktok(in, len, toklen, &h->seq, &h->bol);
+}
+
+static void
+init_destroy(fsm *f)
+{
+	struct init *h = fsm_ctx(f);
+	fsm_destroy(h->fsm);
+	free(h->ps1buf);
+	free(h);
+	return;
+}
+
+static const char *
+init_ps1buf(fsm *f)
+{
+	return ((struct init *)fsm_ctx(f))->ps1buf;
+}
+
+static size_t
+init_ps1bufcnt(fsm *f)
+{
+	return ((struct init *)fsm_ctx(f))->ps1bufcnt;
+}
+
+static bool
+init_anykey(fsm *f)
+{
+	struct init *h = fsm_ctx(f);
+	bool b = h->anykey;
+	h->anykey = false;
+	return b;
+}
+
+static bool
+init_report(fsm *f)
+{
+	struct init *h = fsm_ctx(f);
+	bool b = h->report;
+	h->report = false;
+	return b;
+}
+
+static void
+cmdout_reset(void *ctx)
+{
+	struct cmdout *h = ctx;
+	arena_reset(h->arena);
+	/* prompt first, so the output buffer is on top of the arena
+	 * where it can grow in place */
+	(h->ps1buf = arena_alloc(h->arena, h->ps1bufsz = PS1BUFSZ))[0] = '\0';
+	(h->outbuf = arena_alloc(h->arena, h->outbufsz = OUTBUFSZ))[0] = '\0';
+	h->ps1bufcnt = 0;
+	h->outbufcnt = 0;
+	h->more = false;
+	h->bol = true;
+	h->npend = h->npre = 0;
+	vt_begin(h->vt);
+	return;
+}
+
+static int
+cmdout_mktok(void *ctx, const uint8_t *in, size_t len, size_t *toklen)
+{
+	struct cmdout *h = ctx;
+	return h->f_mktok(in, len, toklen, &h->seq, &h->bol);
+}
+
+/* what we took for the prompt turned out to be output; replay it and the
+ * escape seqs around it onto the screen, in their original order */
+static void
+demote(struct cmdout *h)
+{
+	size_t i = 0;
+	if (h->ps1bufcnt) {
+		for (; i < h->npre; i++)
+			vt_seq(h->vt, &h->pend[i]);
+		for (size_t j = 0; j < h->ps1bufcnt; j++)
+			vt_putc(h->vt, (unsigned char)h->ps1buf[j]);
+	}
+	for (; i < h->npend; i++)
+		vt_seq(h->vt, &h->pend[i]);
+
+	h->npend = h->npre = 0;
+	h->ps1bufcnt = 0;
+	h->ps1buf[0] = '\0';
+	return;
+}
+
+/* the screen hands us rendered output */
+static void
+emit(void *ctx, const char *data, size_t len)
+{
+	struct cmdout *h = ctx;
+	if (h->outbufcnt + len >= h->outbufsz) {
+		size_t nsz = h->outbufsz * 2;
+		while (h->outbufcnt + len >= nsz)
+			nsz *= 2;
+
+		h->outbuf = arena_grow(h->arena, h->outbuf, h->outbufsz, nsz);
+		h->outbufsz = nsz;
+	}
+
+	memcpy(h->outbuf + h->outbufcnt, data, len);
+	h->outbufcnt += len;
+	h->outbuf[h->outbufcnt] = '\0';
+	return;
+}
+
+static void
+cmdout_destroy(fsm *f)
+{
+	struct cmdout *h = fsm_ctx(f);
+	fsm_destroy(h->fsm);
+	vt_destroy(h->vt);
+	arena_destroy(h->arena);
+	free(h);
+	return;
+}
+
+static const char *
+cmdout_ps1buf(fsm *f)
+{
+	return ((struct cmdout *)fsm_ctx(f))->ps1buf;
+}
+
+static size_t
+cmdout_ps1bufcnt(fsm *f)
+{
+	return ((struct cmdout *)fsm_ctx(f))->ps1bufcnt;
+}
+
+static const char *
+cmdout_outbuf(fsm *f)
+{
+	return ((struct cmdout *)fsm_ctx(f))->outbuf;
+}
+
+static size_t
+cmdout_outbufcnt(fsm *f)
+{
+	return ((struct cmdout *)fsm_ctx(f))->outbufcnt;
+}
+
+/* what sc has handed out already, while the command is running */
+static void
+cmdout_outdrop(fsm *f, size_t n)
+{
+	struct cmdout *h = fsm_ctx(f);
+	if (n > h->outbufcnt)
+		n = h->outbufcnt;
+
+	memmove(h->outbuf, h->outbuf + n, h->outbufcnt - n + 1);
+	h->outbufcnt -= n;
+	return;
+}
+
+static bool
+cmdout_more(fsm *f)
+{
+	struct cmdout *h = fsm_ctx(f);
+	bool b = h->more;
+	h->more = false;
+	return b;
+}
+
+static void
+inchar_reset(void *ctx)
+{
+	((struct inchar *)ctx)->bol = true;
+	return;
+}
+
+static int
+inchar_mktok(void *ctx, const uint8_t *in, size_t len, size_t *toklen)
+{
+	struct inchar *h = ctx;
+	return h->f_mktok(in, len, toklen, &h->seq, &h->bol);
+}
+
+static void
+inchar_destroy(fsm *f)
+{
+	struct inchar *h = fsm_ctx(f);
+	fsm_destroy(h->fsm);
+	free(h);
+	return;
+}
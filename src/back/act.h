@@ -0,0 +1,66 @@
+/* act.h - FSM state and actions the backends have in common, for fsm_*_*
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef BACK_ACT_H
+#define BACK_ACT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ansiseq.h"
+#include "fsm.h"
+#include "fsm_cmdout.h"
+#include "fsm_inchar.h"
+#include "fsm_init.h"
+
+/* What tells the backends apart is how they tokenize and what their
+ * transitions are; the rest is here.  A backend's fsm_*_new() hands its
+ * transitions (using the actions below) and its tokenizer to act_*_new(),
+ * and its attach function has act_*_attach() fill in everything but
+ * f_new and what's about the switch rather than the FSM (f_setup,
+ * f_detect, f_errors) */
+
+/* Like fsm_mktok_fn, for the FSMs made here.  Escape sequences are
+ * stored in `*seq`; `*bol` is whether we're at the start of a line, for
+ * the tokenizer to keep track of (true to begin with) */
+typedef int (*act_mktok_fn)(const uint8_t *in, size_t len, size_t *toklen,
+                            struct ansiseq *seq, bool *bol);
+
+/* The init FSM records the prompt, and notes when the switch wants the
+ * any key pressed or the terminal size reported */
+fsm *act_init_new(size_t nsta, size_t ntok, int errst, int inist,
+                  int *accst, size_t naccst, struct fsm_trans *delta,
+                  act_mktok_fn f_mktok);
+void act_init_attach(struct fsm_init_if *ifc);
+void act_ak(void *ctx, int c);      /* the any key has to be pressed */
+void act_report(void *ctx, int c);  /* the terminal size is wanted */
+void act_initps(void *ctx, int c);  /* `c` is part of the prompt */
+
+/* The cmdout FSM renders output on a virtual screen, so repaints don't
+ * end up in it.  Whatever follows the last escape seqs after the output
+ * is the prompt -- unless it's followed by more escape seqs and more
+ * output, in which case it is demoted to output.  The pager can
+ * interrupt the output at any point; sc presses a key then */
+fsm *act_cmdout_new(size_t nsta, size_t ntok, int errst, int inist,
+                    int *accst, size_t naccst, struct fsm_trans *delta,
+                    act_mktok_fn f_mktok);
+void act_cmdout_attach(struct fsm_cmdout_if *ifc);
+void act_rec(void *ctx, int c);     /* put `c` on the screen */
+void act_seq(void *ctx, int c);     /* apply the escape seq to it */
+void act_pend(void *ctx, int c);    /* hold on to the escape seq */
+void act_recps(void *ctx, int c);   /* `c` might be part of the prompt */
+void act_demote(void *ctx, int c);  /* it wasn't, and here's more output */
+void act_more(void *ctx, int c);    /* the pager wants a keypress */
+void act_demore(void *ctx, int c);  /* ... after what we took for a prompt */
+void act_noout(void *ctx, int c);   /* done; what we have is the prompt */
+void act_fin(void *ctx, int c);     /* done, with output and a prompt */
+
+/* The inchar FSM just eats the echo */
+fsm *act_inchar_new(size_t nsta, size_t ntok, int errst, int inist,
+                    int *accst, size_t naccst, struct fsm_trans *delta,
+                    act_mktok_fn f_mktok);
+void act_inchar_attach(struct fsm_inchar_if *ifc);
+
+#endif
@@ -48,19 +48,26 @@
 #define MAX_CALLBACKS 64
 
 
+/* where ansiseq_eatone() is at; on its stack, so it is reentrant */
+struct parse {
+	struct ansiseq seq;
+	int parmv;
+	bool gotparm;
+};
+
 struct transition {
 	int state;
-	void (*action)(int);
+	void (*action)(struct parse *p, int c);
 };
 
-static void act_nop(int c);
-static void act_begin(int c);
-static void act_stor(int c);
-static void act_mkctl(int c);
-static void act_mkpar(int c);
-static void act_mkstr(int c);
-static void act_setcls(int c);
-static void act_ext(int c);
+static void act_nop(struct parse *p, int c);
+static void act_begin(struct parse *p, int c);
+static void act_stor(struct parse *p, int c);
+static void act_mkctl(struct parse *p, int c);
+static void act_mkpar(struct parse *p, int c);
+static void act_mkstr(struct parse *p, int c);
+static void act_setcls(struct parse *p, int c);
+static void act_ext(struct parse *p, int c);
 static int mktok(int c);
 
 /* :set nowrap to read this table */
@@ -75,10 +82,8 @@ static struct transition delta[][NUM_TOKENS] = {
 };
 #undef ERR
 
+/* what every sequence starts out as; read-only after ansiseq_init() */
 static struct ansiseq s_protoseq;
-static struct ansiseq s_curseq;
-static int s_parmv = 0;
-static bool s_gotparm;
 
 
 void
@@ -96,20 +101,23 @@ ansiseq_eatone(const uint8_t *data, size_t len, struct ansiseq *dst)
 	size_t i = 0;
 
 	int st = S_STA;
+	struct parse p;
 	struct transition tr;
 	int c;
 
 	while (i < len) {
 		c = data[i++];
 		tr = delta[st][mktok(c)];
-		tr.action(c);
+		tr.action(&p, c);
 		int prevst = st;
 		st = tr.state;
 
-		if (st == S_ERR)
-			C("error state reached through 0x%02x (%c) "
+		if (st == S_ERR) {
+			W("error state reached through 0x%02x (%c) "
 			  "at input byte %zu (prevstate %d)",
 			  c, c, i, prevst);
+			return -2;
+		}
 
 		if (st == S_FIN)
 			break;
@@ -119,7 +127,7 @@ ansiseq_eatone(const uint8_t *data, size_t len, struct ansiseq *dst)
 		return -1; //not enough data
 
 	if (dst)
-		*dst = s_curseq;
+		*dst = p.seq;
 
 	return i;
 }
@@ -143,78 +151,86 @@ ansiseq_dump(struct ansiseq *cs)
 
 
 static void
-act_nop(int c)
+act_nop(struct parse *p, int c)
 {
+	(void)p;
 	(void)c;
 	return;
 }
 
 static void
-act_begin(int c)
+act_begin(struct parse *p, int c)
 {
 	(void)c;
-	s_curseq = s_protoseq;
-	s_gotparm = false;
-	s_parmv = 0;
+	p->seq = s_protoseq;
+	p->gotparm = false;
+	p->parmv = 0;
 	return;
 }
 
 static void
-act_stor(int c)
+act_stor(struct parse *p, int c)
 {
+	if (p->seq.argc == MAX_ANSISEQ_PARAMS) {
+		W("too many parameters, ignoring the excess");
+		p->parmv = 0;
+		p->gotparm = false;
+		return;
+	}
+
 	if (c == ';')
-		s_curseq.argv[s_curseq.argc++] = s_gotparm?s_parmv:ABSENT;
-	else if (s_gotparm)
-		s_curseq.argv[s_curseq.argc++] = s_parmv;
+		p->seq.argv[p->seq.argc++] = p->gotparm?p->parmv:ABSENT;
+	else if (p->gotparm)
+		p->seq.argv[p->seq.argc++] = p->parmv;
 
-	s_parmv = 0;
-	s_gotparm = false;
+	p->parmv = 0;
+	p->gotparm = false;
 	return;
 }
 
 static void
-act_mkctl(int c)
+act_mkctl(struct parse *p, int c)
 {
-	if (s_gotparm)
-		act_stor(0);
+	if (p->gotparm)
+		act_stor(p, 0);
 
-	s_curseq.cmd = c;
+	p->seq.cmd = c;
 	return;
 }
 
 static void
-act_mkpar(int c)
+act_mkpar(struct parse *p, int c)
 {
-	s_parmv = s_parmv * 10 + (c - '0');
-	s_gotparm = true;
+	p->parmv = p->parmv * 10 + (c - '0');
+	p->gotparm = true;
 	return;
 }
 
 static void
-act_mkstr(int c)
+act_mkstr(struct parse *p, int c)
 {
-	size_t len = strlen((const char *)s_curseq.strarg);
-	if (len + 1 >= sizeof s_curseq.strarg) {
+	size_t len = strlen((const char *)p->seq.strarg);
+	if (len + 1 >= sizeof p->seq.strarg) {
 		W("OSC control sequence truncated");
 		return;
 	}
 
-	s_curseq.strarg[len] = c;
+	p->seq.strarg[len] = c;
 	return;
 }
 
 static void
-act_setcls(int c)
+act_setcls(struct parse *p, int c)
 {
-	s_curseq.cls = c;
+	p->seq.cls = c;
 	return;
 }
 
 static void
-act_ext(int c)
+act_ext(struct parse *p, int c)
 {
 	(void)c;
-	s_curseq.ext = true;
+	p->seq.ext = true;
 	return;
 }
 
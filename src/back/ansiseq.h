@@ -25,6 +25,8 @@ struct ansiseq {
 
 void ansiseq_init(void);
 
+/* Parse the sequence at the start of `data` into `*dst`.  Returns its
+ * length, -1 if it's incomplete, -2 if it's malformed */
 int ansiseq_eatone(const uint8_t *data, size_t len, struct ansiseq *dst);
 
 void ansiseq_dump(struct ansiseq *cs);
@@ -3,3 +3,4 @@
  * See README for contact-, COPYING for license information. */
 
 X(hp)
+X(def)
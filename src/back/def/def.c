@@ -0,0 +1,453 @@
+/* def.c - Backend definitions loaded at runtime, for fsm_*_def
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_BACK_DEF_DEF
+
+#include "def.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../common/common.h"
+#include "../../common/log.h"
+
+#define LINESZ 1024
+#define MAXWORDS 64
+#define NAMESZ 32
+#define MAXSTATES 64
+#define MAXTOKENS 16
+#define MAXSIGS 16
+#define MAXREJECTS 32
+#define SETUPSZ 1024
+
+/* token classes */
+#define TK_ESCAPE 0
+#define TK_STRING 1
+#define TK_ANY 2
+#define TK_EOF 3
+
+
+struct tok {
+	char name[NAMESZ];
+	int kind;
+	char *str; /* TK_STRING only */
+	size_t len;
+	bool bol;  /* TK_STRING only: matches at the start of a line only */
+};
+
+/* as given; actions are looked up by name once we know what's on offer */
+struct trans {
+	int from, tok, to;
+	char act[NAMESZ];
+	unsigned long lineno;
+};
+
+struct dfsm {
+	bool present;
+	struct tok toks[MAXTOKENS];
+	size_t ntok;
+	int eoftok;
+	char states[MAXSTATES][NAMESZ];
+	size_t nsta;
+	int accst[MAXSTATES];
+	size_t naccst;
+	int errst;
+	struct trans *trans;
+	size_t ntrans, transsz;
+};
+
+static const char *const s_fsmnames[DEF_NUMFSMS] = {
+	[DEF_INIT] = "init",
+	[DEF_CMDOUT] = "cmdout",
+	[DEF_INCHAR] = "inchar",
+};
+
+static bool s_loaded;
+static char s_path[256];
+static char s_name[NAMESZ] = "def";
+static char *s_sigs[MAXSIGS + 1];
+static size_t s_nsigs;
+static char s_setup[SETUPSZ];
+static char *s_rejects[MAXREJECTS + 1];
+static size_t s_nrejects;
+static struct dfsm s_fsms[DEF_NUMFSMS];
+
+
+static bool statement(char **w, bool *quoted, size_t nw, int *cur,
+                      unsigned long ln);
+static bool check(int which);
+static int findstate(struct dfsm *d, const char *name, unsigned long ln);
+static int findtok(struct dfsm *d, const char *name, unsigned long ln);
+static bool bad(unsigned long ln, const char *fmt, ...);
+static void unload(void);
+
+
+int
+def_load(const char *path)
+{
+	unload();
+	snprintf(s_path, sizeof s_path, "%s", path);
+	FILE *fp = fopen(path, "r");
+	if (!fp) {
+		EE("cannot open backend definition '%s'", path);
+		return -1;
+	}
+
+	char line[LINESZ];
+	char *w[MAXWORDS];
+	bool quoted[MAXWORDS];
+	int cur = -1; /* the fsm section we're in */
+	unsigned long ln = 0;
+	bool ok = true;
+	while (ok && fgets(line, sizeof line, fp)) {
+		ln++;
+		size_t nw;
+		char err[128];
+		if (!strchr(line, '\n') && !feof(fp)) {
+			E("%s:%lu: line too long", s_path, ln);
+			ok = false;
+		} else if (!splitwords(line, w, quoted, MAXWORDS, &nw,
+		    err, sizeof err))
+			ok = bad(ln, "%s", err);
+		else
+			ok = !nw || statement(w, quoted, nw, &cur, ln);
+	}
+
+	if (ok && ferror(fp)) {
+		EE("reading '%s'", path);
+		ok = false;
+	}
+	fclose(fp);
+
+	for (int i = 0; ok && i < DEF_NUMFSMS; i++)
+		ok = check(i);
+
+	if (!ok) {
+		unload();
+		return -1;
+	}
+
+	s_loaded = true;
+	N("loaded backend '%s' from '%s'", s_name, path);
+	return 0;
+}
+
+bool
+def_loaded(void)
+{
+	return s_loaded;
+}
+
+const char *
+def_name(void)
+{
+	return s_name;
+}
+
+const char *const *
+def_signatures(void)
+{
+	return (const char *const *)s_sigs;
+}
+
+const char *
+def_setup(void)
+{
+	return s_setup;
+}
+
+const char *const *
+def_rejects(void)
+{
+	return (const char *const *)s_rejects;
+}
+
+struct fsm_trans *
+def_delta(int which, const struct def_action *acts)
+{
+	struct dfsm *d = &s_fsms[which];
+	void (*nop)(void *, int) = NULL;
+	for (const struct def_action *a = acts; a->name; a++)
+		if (strcmp(a->name, "nop") == 0)
+			nop = a->fn;
+	if (!nop)
+		C("bug: fsm %s has no nop action", s_fsmnames[which]);
+
+	for (size_t i = 0; i < d->ntrans; i++) {
+		struct trans *t = &d->trans[i];
+		const struct def_action *a = acts;
+		while (a->name && strcmp(a->name, t->act) != 0)
+			a++;
+		if (!a->name) {
+			bad(t->lineno, "fsm %s has no action '%s'",
+			    s_fsmnames[which], t->act);
+			unload();
+			return NULL;
+		}
+	}
+
+	struct fsm_trans *delta = xmalloc(d->nsta * d->ntok * sizeof *delta);
+	for (size_t i = 0; i < d->nsta * d->ntok; i++)
+		delta[i] = (struct fsm_trans){d->errst, nop};
+
+	for (size_t i = 0; i < d->ntrans; i++) {
+		struct trans *t = &d->trans[i];
+		const struct def_action *a = acts;
+		while (strcmp(a->name, t->act) != 0)
+			a++;
+
+		delta[t->from * d->ntok + t->tok] = (struct fsm_trans){t->to,
+		                                                       a->fn};
+	}
+
+	return delta;
+}
+
+void
+def_shape(int which, size_t *nsta, size_t *ntok, int *errst, int *inist,
+          const int **accst, size_t *naccst)
+{
+	struct dfsm *d = &s_fsms[which];
+	*nsta = d->nsta;
+	*ntok = d->ntok;
+	*errst = d->errst;
+	*inist = 0;
+	*accst = d->accst;
+	*naccst = d->naccst;
+	return;
+}
+
+int
+def_mktok(int which, const uint8_t *in, size_t len, size_t *toklen,
+          struct ansiseq *seq, bool *bol)
+{
+	struct dfsm *d = &s_fsms[which];
+	if (!in)
+		return d->eoftok;
+
+	for (size_t i = 0; i < d->ntok; i++) {
+		struct tok *t = &d->toks[i];
+		switch (t->kind) {
+		case TK_ESCAPE: {
+			if (in[0] != '\033')
+				break;
+
+			int r = ansiseq_eatone(in, len, seq);
+			if (r < 0)
+				return r;
+
+			*toklen = r;
+			*bol = true;
+			return i;
+		}
+		case TK_STRING:
+			if (t->bol && !*bol)
+				break;
+			if (memcmp(in, t->str, len < t->len ? len : t->len) != 0)
+				break;
+			if (len < t->len)
+				return -1;
+
+			*toklen = t->len;
+			*bol = t->str[t->len-1] == '\r' || t->str[t->len-1] == '\n';
+			return i;
+		case TK_ANY:
+			*toklen = 1;
+			*bol = in[0] == '\r' || in[0] == '\n';
+			return i;
+		}
+	}
+
+	return -2; /* nothing we were told about */
+}
+
+
+
+static bool
+statement(char **w, bool *quoted, size_t nw, int *cur, unsigned long ln)
+{
+	struct dfsm *d = *cur == -1 ? NULL : &s_fsms[*cur];
+	const char *kw = w[0];
+
+	if (strcmp(kw, "name") == 0 && nw == 2) {
+		snprintf(s_name, sizeof s_name, "%s", w[1]);
+	} else if (strcmp(kw, "detect") == 0 && nw == 2) {
+		if (s_nsigs == MAXSIGS)
+			return bad(ln, "too many signatures");
+		s_sigs[s_nsigs++] = xstrdup(w[1]);
+	} else if (strcmp(kw, "setup") == 0 && nw == 2) {
+		size_t n = strlen(s_setup);
+		if (n + strlen(w[1]) >= sizeof s_setup)
+			return bad(ln, "too many setup commands");
+		strcpy(s_setup + n, w[1]);
+	} else if (strcmp(kw, "reject") == 0 && nw == 2) {
+		if (s_nrejects == MAXREJECTS)
+			return bad(ln, "too many reject messages");
+		s_rejects[s_nrejects++] = xstrdup(w[1]);
+	} else if (strcmp(kw, "fsm") == 0 && nw == 2) {
+		for (*cur = 0; *cur < DEF_NUMFSMS; (*cur)++)
+			if (strcmp(s_fsmnames[*cur], w[1]) == 0)
+				break;
+		if (*cur == DEF_NUMFSMS)
+			return bad(ln, "no such fsm '%s'", w[1]);
+		if (s_fsms[*cur].present)
+			return bad(ln, "fsm '%s' again", w[1]);
+		s_fsms[*cur].present = true;
+		s_fsms[*cur].eoftok = -1;
+		s_fsms[*cur].errst = -1;
+	} else if (!d) {
+		return bad(ln, "bad statement '%s', or not in an fsm section",
+		           kw);
+	} else if (strcmp(kw, "token") == 0 && (nw == 3 || nw == 4)) {
+		if (d->ntok == MAXTOKENS)
+			return bad(ln, "too many tokens");
+		if (nw == 4 && (!quoted[2] || strcmp(w[3], "bol") != 0))
+			return bad(ln, "only a string token can be 'bol'");
+
+		struct tok *t = &d->toks[d->ntok];
+		snprintf(t->name, sizeof t->name, "%s", w[1]);
+		if (quoted[2]) {
+			if (!*w[2])
+				return bad(ln, "empty token string");
+			t->kind = TK_STRING;
+			t->str = xstrdup(w[2]);
+			t->len = strlen(w[2]);
+			t->bol = nw == 4;
+		} else if (strcmp(w[2], "escape") == 0)
+			t->kind = TK_ESCAPE;
+		else if (strcmp(w[2], "any") == 0)
+			t->kind = TK_ANY;
+		else if (strcmp(w[2], "eof") == 0) {
+			t->kind = TK_EOF;
+			d->eoftok = (int)d->ntok;
+		} else
+			return bad(ln, "bad token class '%s'", w[2]);
+		d->ntok++;
+	} else if (strcmp(kw, "state") == 0 && nw >= 2) {
+		for (size_t i = 1; i < nw; i++) {
+			if (d->nsta == MAXSTATES)
+				return bad(ln, "too many states");
+			snprintf(d->states[d->nsta++], NAMESZ, "%s", w[i]);
+		}
+	} else if (strcmp(kw, "accept") == 0 && nw >= 2) {
+		for (size_t i = 1; i < nw; i++) {
+			if (d->naccst == MAXSTATES)
+				return bad(ln, "too many accepting states");
+			int st = findstate(d, w[i], ln);
+			if (st == -1)
+				return false;
+			d->accst[d->naccst++] = st;
+		}
+	} else if (strcmp(kw, "error") == 0 && nw == 2) {
+		if ((d->errst = findstate(d, w[1], ln)) == -1)
+			return false;
+	} else if (strcmp(kw, "on") == 0 && (nw == 4 || nw == 5)) {
+		struct trans t;
+		if ((t.from = findstate(d, w[1], ln)) == -1
+		    || (t.tok = findtok(d, w[2], ln)) == -1
+		    || (t.to = findstate(d, w[3], ln)) == -1)
+			return false;
+		snprintf(t.act, sizeof t.act, "%s", nw == 5 ? w[4] : "nop");
+		t.lineno = ln;
+
+		if (d->ntrans == d->transsz)
+			d->trans = xrealloc(d->trans, (d->transsz = d->transsz
+			                    ? d->transsz * 2 : 32) * sizeof *d->trans);
+		d->trans[d->ntrans++] = t;
+	} else
+		return bad(ln, "bad statement '%s'", kw);
+
+	return true;
+}
+
+/* make sure fsm `which` is something fsm_new() can work with */
+static bool
+check(int which)
+{
+	struct dfsm *d = &s_fsms[which];
+	const char *n = s_fsmnames[which];
+	if (!d->present)
+		return bad(0, "fsm %s missing", n);
+	if (!d->nsta || !d->ntok)
+		return bad(0, "fsm %s needs states and tokens", n);
+	if (d->errst == -1)
+		return bad(0, "fsm %s has no error state", n);
+	if (!d->naccst)
+		return bad(0, "fsm %s has no accepting state", n);
+	if (d->eoftok == -1)
+		return bad(0, "fsm %s has no eof token", n);
+	return true;
+}
+
+static int
+findstate(struct dfsm *d, const char *name, unsigned long ln)
+{
+	for (size_t i = 0; i < d->nsta; i++)
+		if (strcmp(d->states[i], name) == 0)
+			return (int)i;
+
+	bad(ln, "no state '%s'", name);
+	return -1;
+}
+
+static int
+findtok(struct dfsm *d, const char *name, unsigned long ln)
+{
+	for (size_t i = 0; i < d->ntok; i++)
+		if (strcmp(d->toks[i].name, name) == 0)
+			return (int)i;
+
+	bad(ln, "no token '%s'", name);
+	return -1;
+}
+
+/* complain about line `ln` (0: the file as a whole); always false */
+static bool
+bad(unsigned long ln, const char *fmt, ...)
+{
+	char msg[256];
+	va_list l;
+	va_start(l, fmt);
+	vsnprintf(msg, sizeof msg, fmt, l);
+	va_end(l);
+
+	if (ln)
+		E("%s:%lu: %s", s_path, ln, msg);
+	else
+		E("%s: %s", s_path, msg);
+	return false;
+}
+
+/* forget about whatever we've read so far */
+static void
+unload(void)
+{
+	for (size_t i = 0; i < s_nsigs; i++)
+		free(s_sigs[i]);
+	for (size_t i = 0; i < s_nrejects; i++)
+		free(s_rejects[i]);
+	for (int i = 0; i < DEF_NUMFSMS; i++) {
+		struct dfsm *d = &s_fsms[i];
+		for (size_t j = 0; j < d->ntok; j++)
+			if (d->toks[j].kind == TK_STRING)
+				free(d->toks[j].str);
+		free(d->trans);
+	}
+
+	memset(s_sigs, 0, sizeof s_sigs);
+	memset(s_rejects, 0, sizeof s_rejects);
+	memset(s_fsms, 0, sizeof s_fsms);
+	s_nsigs = s_nrejects = 0;
+	s_setup[0] = '\0';
+	snprintf(s_name, sizeof s_name, "def");
+	s_loaded = false;
+	return;
+}
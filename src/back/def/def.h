@@ -0,0 +1,79 @@
+/* def.h - Backend definitions loaded at runtime, for fsm_*_def
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef BACK_DEF_DEF_H
+#define BACK_DEF_DEF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../ansiseq.h"
+#include "../fsm.h"
+
+/* A definition file describes a switch the way fsm_*_hp.c do in C.  One
+ * statement per line, '#' starts a comment, strings are double-quoted
+ * and know \n, \r, \t, \e, \\ and \".  E.g.:
+ *
+ *   name    procurve             # for the logs
+ *   detect  "Press any key"      # banner signatures, any number of them
+ *   setup   "no page\n"          # commands to issue once logged in
+ *   reject  "Invalid input"      # what the CLI says to a bad command
+ *
+ *   fsm init                     # init, cmdout or inchar; the rest of
+ *                                # the statements are about this one
+ *   token   ESEQ escape          # token classes, tried in this order:
+ *   token   MORE "-- MORE --" bol #  an escape sequence, a string (with
+ *   token   REST any             #   "bol", only at the start of a
+ *   token   EOF eof              #   line), any one byte, end of data
+ *   state   STA LIC ANY FIN ERR  # all of them, the first one is initial
+ *   accept  FIN
+ *   error   ERR
+ *   on      STA REST LIC         # in STA, a REST takes us to LIC
+ *   on      ANY ESEQ FIN anykey  # ... calling action "anykey"
+ *
+ * Transitions not given lead to the error state.  The actions each FSM
+ * knows are those of its fsm_*_def.c */
+
+#define DEF_INIT 0
+#define DEF_CMDOUT 1
+#define DEF_INCHAR 2
+#define DEF_NUMFSMS 3
+
+/* What fsm_*_def.c have to offer; NULL-terminated */
+struct def_action {
+	const char *name;
+	void (*fn)(void *ctx, int c);
+};
+
+/* Read and check the definition in `path`; -1 (after saying why) if
+ * it's missing or broken.  Until this succeeds, the def backend doesn't
+ * recognize any switch */
+int def_load(const char *path);
+bool def_loaded(void);
+
+/* The stuff that isn't about an FSM; NULL-terminated lists */
+const char *def_name(void);
+const char *const *def_signatures(void);
+const char *def_setup(void);
+const char *const *def_rejects(void);
+
+/* Turn the transitions of FSM `which` into an fsm_new() table, with the
+ * actions taken from `acts`.  The table is the caller's to free.  NULL
+ * if it wants an action that isn't there; the definition is dropped
+ * then, as if def_load() had failed */
+struct fsm_trans *def_delta(int which, const struct def_action *acts);
+
+/* fsm_new() arguments for FSM `which` */
+void def_shape(int which, size_t *nsta, size_t *ntok, int *errst,
+               int *inist, const int **accst, size_t *naccst);
+
+/* Tokenize for FSM `which`, like fsm_hp_mktok().  `*bol` is whether
+ * we're at the start of a line, i.e. right after an escape sequence, a
+ * CR or a LF (start out with it true); "bol" string tokens match only
+ * there */
+int def_mktok(int which, const uint8_t *in, size_t len, size_t *toklen,
+              struct ansiseq *seq, bool *bol);
+
+#endif
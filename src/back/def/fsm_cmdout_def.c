@@ -0,0 +1,84 @@
+/* fsm_cmdout_def.c - FSM eating cmd output as defined at runtime, by sc
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_BACK_DEF_FSM_CMDOUT_DEF
+
+#include "../act.h"
+#include "../fsm_cmdout.h"
+#include "def.h"
+#include "../../common/common.h"
+#include "../../common/log.h"
+
+
+static int mktok(const uint8_t *in, size_t len, size_t *toklen,
+                 struct ansiseq *seq, bool *bol);
+static fsm *new(void);
+static const char *const *errors(fsm *f);
+
+/* what the definition's cmdout FSM may do; see fsm_cmdout_hp.c for how
+ * they fit together */
+static const struct def_action s_actions[] = {
+	{"nop", fsm_nop},
+	{"out", act_rec},
+	{"seq", act_seq},
+	{"pend", act_pend},
+	{"prompt", act_recps},
+	{"demote", act_demote},
+	{"more", act_more},
+	{"demore", act_demore},
+	{"noout", act_noout},
+	{"fin", act_fin},
+	{NULL, NULL}
+};
+
+static struct fsm_trans *s_delta; /* compiled from the definition */
+
+
+static int
+mktok(const uint8_t *in, size_t len, size_t *toklen, struct ansiseq *seq,
+      bool *bol)
+{
+	return def_mktok(DEF_CMDOUT, in, len, toklen, seq, bol);
+}
+
+static fsm *
+new(void)
+{
+	if (!s_delta)
+		C("no backend definition loaded");
+
+	size_t nsta, ntok, naccst;
+	int errst, inist;
+	const int *accst;
+	def_shape(DEF_CMDOUT, &nsta, &ntok, &errst, &inist, &accst, &naccst);
+	return act_cmdout_new(nsta, ntok, errst, inist, (int *)accst, naccst,
+	                      s_delta, mktok);
+}
+
+static const char *const *
+errors(fsm *f)
+{
+	(void)f;
+	return def_rejects();
+}
+
+
+void
+fsm_cmdout_def_attach(struct fsm_cmdout_if *ifc)
+{
+	if (def_loaded() && !s_delta)
+		s_delta = def_delta(DEF_CMDOUT, s_actions);
+
+	/* attach pointers to the above functions to the interface
+	 * struct pointed to by `ifc`; the rest is act.c's */
+	act_cmdout_attach(ifc);
+	ifc->f_new = new;
+	ifc->f_errors = errors;
+	I("fsm_cmdout_def attached");
+	return;
+}
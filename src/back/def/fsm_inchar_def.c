@@ -0,0 +1,65 @@
+/* fsm_inchar_def.c - FSM eating input char echo as defined at runtime, by sc
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_BACK_DEF_FSM_INCHAR_DEF
+
+#include "../act.h"
+#include "../fsm_inchar.h"
+#include "def.h"
+#include "../../common/common.h"
+#include "../../common/log.h"
+
+
+static int mktok(const uint8_t *in, size_t len, size_t *toklen,
+                 struct ansiseq *seq, bool *bol);
+static fsm *new(void);
+
+/* what the definition's inchar FSM may do */
+static const struct def_action s_actions[] = {
+	{"nop", fsm_nop},
+	{NULL, NULL}
+};
+
+static struct fsm_trans *s_delta; /* compiled from the definition */
+
+
+static int
+mktok(const uint8_t *in, size_t len, size_t *toklen, struct ansiseq *seq,
+      bool *bol)
+{
+	return def_mktok(DEF_INCHAR, in, len, toklen, seq, bol);
+}
+
+static fsm *
+new(void)
+{
+	if (!s_delta)
+		C("no backend definition loaded");
+
+	size_t nsta, ntok, naccst;
+	int errst, inist;
+	const int *accst;
+	def_shape(DEF_INCHAR, &nsta, &ntok, &errst, &inist, &accst, &naccst);
+	return act_inchar_new(nsta, ntok, errst, inist, (int *)accst, naccst,
+	                      s_delta, mktok);
+}
+
+
+void
+fsm_inchar_def_attach(struct fsm_inchar_if *ifc)
+{
+	if (def_loaded() && !s_delta)
+		s_delta = def_delta(DEF_INCHAR, s_actions);
+
+	/* attach pointers to the above functions to the interface
+	 * struct pointed to by `ifc`; the rest is act.c's */
+	act_inchar_attach(ifc);
+	ifc->f_new = new;
+	I("fsm_inchar_def attached");
+	return;
+}
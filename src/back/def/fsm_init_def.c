@@ -0,0 +1,97 @@
+/* fsm_init_def.c - FSM eating initial chat as defined at runtime, by sc
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_BACK_DEF_FSM_INIT_DEF
+
+#include <string.h>
+
+#include "../act.h"
+#include "../fsm_init.h"
+#include "def.h"
+#include "../../common/common.h"
+#include "../../common/log.h"
+
+
+static int mktok(const uint8_t *in, size_t len, size_t *toklen,
+                 struct ansiseq *seq, bool *bol);
+static fsm *new(void);
+static const char *setup(fsm *f);
+static int detect(const uint8_t *data, size_t len);
+
+/* what the definition's init FSM may do */
+static const struct def_action s_actions[] = {
+	{"nop", fsm_nop},
+	{"anykey", act_ak},
+	{"report", act_report},
+	{"prompt", act_initps},
+	{NULL, NULL}
+};
+
+static struct fsm_trans *s_delta; /* compiled from the definition */
+
+
+static int
+mktok(const uint8_t *in, size_t len, size_t *toklen, struct ansiseq *seq,
+      bool *bol)
+{
+	return def_mktok(DEF_INIT, in, len, toklen, seq, bol);
+}
+
+static fsm *
+new(void)
+{
+	if (!s_delta)
+		C("no backend definition loaded");
+
+	size_t nsta, ntok, naccst;
+	int errst, inist;
+	const int *accst;
+	def_shape(DEF_INIT, &nsta, &ntok, &errst, &inist, &accst, &naccst);
+	return act_init_new(nsta, ntok, errst, inist, (int *)accst, naccst,
+	                    s_delta, mktok);
+}
+
+static const char *
+setup(fsm *f)
+{
+	(void)f;
+	return def_setup();
+}
+
+/* any of the definition's signatures will do.  without any, it's never
+ * us; without a match, it might still be */
+static int
+detect(const uint8_t *data, size_t len)
+{
+	const char *const *sigs = def_signatures();
+	if (!def_loaded() || !*sigs)
+		return 0;
+
+	for (const char *const *s = sigs; *s; s++)
+		if (hasstr(data, len, *s, strlen(*s)))
+			return 1;
+
+	return -1;
+}
+
+
+void
+fsm_init_def_attach(struct fsm_init_if *ifc)
+{
+	if (def_loaded() && !s_delta)
+		s_delta = def_delta(DEF_INIT, s_actions);
+
+	/* attach pointers to the above functions to the interface
+	 * struct pointed to by `ifc`; the rest is act.c's */
+	act_init_attach(ifc);
+	ifc->f_new = new;
+	ifc->f_setup = setup;
+	ifc->f_detect = detect;
+	I("fsm_init_def attached");
+	return;
+}
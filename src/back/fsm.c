@@ -22,28 +22,42 @@
 
 
 static bool isaccepting(fsm *f, int state);
+static uint8_t actno(fsm *f, fsm_action_fn fn);
 
 
 fsm *
 fsm_new(size_t nsta, size_t ntok, int errst, int inist, int *accst,
         size_t naccst, struct fsm_trans *delta, fsm_mktok_fn f_mktok,
-        fsm_reset_fn f_reset)
+        fsm_reset_fn f_reset, void *ctx)
 {
+	if (nsta > FSM_MAXSTATES)
+		C("too many states (%zu, max %d)", nsta, FSM_MAXSTATES);
+
 	fsm *f = xmalloc(sizeof *f);
 
 	f->nsta = nsta;
 	f->ntok = ntok;
 	f->errst = errst;
 	f->inist = inist;
-	f->naccst = naccst;
 	f->f_mktok = f_mktok;
 	f->f_reset = f_reset;
-
-	f->accst = xmalloc(naccst * sizeof *f->accst);
-	memcpy(f->accst, accst, naccst * sizeof *f->accst);
-
-	f->delta = xmalloc(ntok * nsta * sizeof *f->delta);
-	memcpy(f->delta, delta, ntok * nsta * sizeof *f->delta);
+	f->ctx = ctx;
+	f->backend = 0;
+
+	memset(f->acc, 0, sizeof f->acc);
+	for (size_t i = 0; i < naccst; i++)
+		f->acc[accst[i] / 64] |= UINT64_C(1) << (accst[i] % 64);
+
+	size_t n = nsta * ntok;
+	f->next = xmalloc(2 * n);
+	f->act = f->next + n;
+	f->acts = xmalloc((n + 1) * sizeof *f->acts);
+	f->acts[0] = NULL;
+	f->nacts = 1;
+	for (size_t i = 0; i < n; i++) {
+		f->next[i] = (uint8_t)delta[i].state;
+		f->act[i] = actno(f, delta[i].action);
+	}
 
 	f->curst = f->inist;
 
@@ -53,20 +67,24 @@ fsm_new(size_t nsta, size_t ntok, int errst, int inist, int *accst,
 void
 fsm_destroy(fsm *f)
 {
-	free(f->accst);
-	free(f->delta);
+	free(f->next);
+	free(f->acts);
 	free(f);
 	return;
 }
 
+void *
+fsm_ctx(fsm *f)
+{
+	return f->ctx;
+}
+
 
 size_t
 fsm_feed(fsm *f, const uint8_t *data, size_t len)
 {
 	size_t i = 0;
 
-	struct fsm_trans tr;
-
 	if (f->curst == f->errst)
 		return 0;
 
@@ -77,23 +95,29 @@ fsm_feed(fsm *f, const uint8_t *data, size_t len)
 		size_t toklen = 1;
 		if (data) {
 			c = data[i];
-			t = f->f_mktok(data + i, len - i, &toklen);
+			t = f->f_mktok(f->ctx, data + i, len - i, &toklen);
 			if (t == -1) { //not enough data
 				W("not enough data");
 				return i;
 			}
+			if (t < 0) { //garbage; eat it so the caller notices
+				W("malformed input at byte %zu", i);
+				f->curst = f->errst;
+				return i + 1;
+			}
 		} else {
 			c = EOF;
-			t = f->f_mktok(NULL, 0, &toklen);
+			t = f->f_mktok(f->ctx, NULL, 0, &toklen);
 		}
 
 		i += toklen;
-		tr = f->delta[IND(f, f->curst, t)];
+		size_t ind = IND(f, f->curst, t);
 		if (!len) //probe only
-			return isaccepting(f, tr.state);
+			return isaccepting(f, f->next[ind]);
 
-		tr.action(c);
-		f->curst = tr.state;
+		if (f->act[ind])
+			f->acts[f->act[ind]](f->ctx, c);
+		f->curst = f->next[ind];
 
 		if (f->curst == f->errst || !data)
 			break;
@@ -107,7 +131,7 @@ fsm_reset(fsm *f)
 {
 	f->curst = f->inist;
 	if (f->f_reset)
-		f->f_reset();
+		f->f_reset(f->ctx);
 	return;
 }
 
@@ -126,20 +150,43 @@ fsm_accepting(fsm *f)
 void
 fsm_dump(fsm *f)
 {
-	A("curst=%d, errst=%d, ntok=%zu, nsta=%zu, delta=%p, "
-	  "accst=%p, naccst=%zu,  inist=%d", f->curst,
-	  f->errst, f->ntok, f->nsta, (void *)f->delta,
-	  (void *)f->accst, f->naccst, f->inist);
-	for (size_t i = 0; i < f->naccst; i++)
-		A("accst[%zu]=%d", i, f->accst[i]);
+	A("curst=%d, errst=%d, ntok=%zu, nsta=%zu, nacts=%zu, inist=%d",
+	  f->curst, f->errst, f->ntok, f->nsta, f->nacts, f->inist);
+	for (size_t i = 0; i < f->nsta; i++)
+		if (isaccepting(f, (int)i))
+			A("accepting: %zu", i);
 	return;
 }
 
+void
+fsm_nop(void *ctx, int c)
+{
+	(void)ctx, (void)c;
+	return;
+}
+
+
+
 static bool
 isaccepting(fsm *f, int state)
 {
-	for (size_t i = 0; i < f->naccst; i++)
-		if (state == f->accst[i])
-			return true;
-	return false;
+	return f->acc[state / 64] >> (state % 64) & 1;
+}
+
+/* the number `fn` goes by, giving it one if it has none yet */
+static uint8_t
+actno(fsm *f, fsm_action_fn fn)
+{
+	if (!fn || fn == fsm_nop)
+		return 0;
+
+	for (size_t i = 1; i < f->nacts; i++)
+		if (f->acts[i] == fn)
+			return (uint8_t)i;
+
+	if (f->nacts > UINT8_MAX)
+		C("too many distinct actions");
+
+	f->acts[f->nacts] = fn;
+	return (uint8_t)f->nacts++;
 }
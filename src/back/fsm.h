@@ -9,35 +9,56 @@
 #include <stdbool.h>
 #include <stdint.h>
 
-typedef void (*fsm_reset_fn)(void);
-typedef int (*fsm_mktok_fn)(const uint8_t *in, size_t inlen, size_t *tlen);
+/* tokenizer, actions and reset callback get the `ctx` given to fsm_new().
+ * the tokenizer returns the token, -1 if it needs more data, -2 if the
+ * input is garbage (which puts the FSM in its error state) */
+typedef void (*fsm_reset_fn)(void *ctx);
+typedef int (*fsm_mktok_fn)(void *ctx, const uint8_t *in, size_t inlen,
+                            size_t *tlen);
+typedef void (*fsm_action_fn)(void *ctx, int c);
 
+#define FSM_MAXSTATES 256 /* so a state fits in a byte */
+
+/* The transition table given to fsm_new() is compiled into two byte
+ * arrays, next state and action, indexed by (state, token).  Actions are
+ * numbered in the order they first show up, 0 meaning there's nothing
+ * to call, which is what fsm_nop turns into */
 struct fsm {
 	size_t nsta;              /* number of states */
 	size_t ntok;              /* number of tokens */
 	int curst;                /* current state */
 	int errst;                /* error state */
 	int inist;                /* initial state */
-	int *accst;               /* accepting states */
-	size_t naccst;            /* number of accepting states */
-	struct fsm_trans *delta;  /* transition table (flattened) */
+	uint64_t acc[FSM_MAXSTATES / 64]; /* accepting states, a bit each */
+	uint8_t *next;            /* next state per (state, token) */
+	uint8_t *act;             /* action per (state, token), 0: none */
+	fsm_action_fn *acts;      /* actions by number; acts[0] is unused */
+	size_t nacts;             /* number of actions, counting acts[0] */
 	fsm_mktok_fn f_mktok;     /* tokenizer function */
 	fsm_reset_fn f_reset;     /* reset callback (optional) */
+	void *ctx;                /* per-instance state of whoever made us */
+	int backend;              /* which one that was, see fsm_init_new() */
 };
 
 typedef struct fsm fsm;
 
 struct fsm_trans {
 	int state;
-	void (*action)(int);
+	fsm_action_fn action;
 };
 
+/* Does nothing; use it for transitions that don't need an action, they
+ * then don't cost a call */
+void fsm_nop(void *ctx, int c);
+
 fsm *fsm_new(size_t nsta, size_t ntok, int errst, int inist, int *accst,
              size_t naccst, struct fsm_trans *delta, fsm_mktok_fn f_mktok,
-             fsm_reset_fn f_reset);
+             fsm_reset_fn f_reset, void *ctx);
 
 void fsm_destroy(fsm *f);
 
+void *fsm_ctx(fsm *f);
+
 size_t fsm_feed(fsm *f, const uint8_t *data, size_t len);
 void fsm_reset(fsm *f);
 
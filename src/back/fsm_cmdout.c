@@ -32,58 +32,97 @@ static struct fsm_cmdout_type {
 #undef X
 };
 
-/* Attach point + call dispatch to whatever backend was attached */
-static struct fsm_cmdout_if s_backend;
+/* Attach points + call dispatch, one per backend; those not attached
+ * are all NULL.  Every fsm knows which backend made it */
+static struct fsm_cmdout_if s_ifs[COUNTOF(s_backends)];
 
 
-/* Delegate the backend interface to whatever attached to `s_backend` */
+/* Delegate the backend interface to the backend in charge */
 fsm *
-fsm_cmdout_init(void)
+fsm_cmdout_new(int backend)
 {
-	return s_backend.f_init();
+	fsm *f = s_ifs[backend].f_new();
+	f->backend = backend;
+	return f;
+}
+
+void
+fsm_cmdout_destroy(fsm *f)
+{
+	if (!f)
+		return;
+
+	s_ifs[f->backend].f_destroy(f);
+	return;
 }
 
 const char *
-fsm_cmdout_ps1buf(void)
+fsm_cmdout_ps1buf(fsm *f)
 {
-	return s_backend.f_ps1buf();
+	return s_ifs[f->backend].f_ps1buf(f);
+}
+
+size_t
+fsm_cmdout_ps1bufcnt(fsm *f)
+{
+	return s_ifs[f->backend].f_ps1bufcnt(f);
 }
 
 const char *
-fsm_cmdout_outbuf(void)
+fsm_cmdout_outbuf(fsm *f)
 {
-	return s_backend.f_outbuf();
+	return s_ifs[f->backend].f_outbuf(f);
 }
 
 size_t
-fsm_cmdout_outbufcnt(void)
+fsm_cmdout_outbufcnt(fsm *f)
+{
+	return s_ifs[f->backend].f_outbufcnt(f);
+}
+
+void
+fsm_cmdout_outdrop(fsm *f, size_t n)
+{
+	s_ifs[f->backend].f_outdrop(f, n);
+	return;
+}
+
+bool
+fsm_cmdout_anykey(fsm *f)
 {
-	return s_backend.f_outbufcnt();
+	return s_ifs[f->backend].f_anykey(f);
 }
 
 bool
-fsm_cmdout_anykey(void)
+fsm_cmdout_report(fsm *f)
 {
-	return s_backend.f_anykey();
+	return s_ifs[f->backend].f_report(f);
 }
 
 bool
-fsm_cmdout_report(void)
+fsm_cmdout_more(fsm *f)
+{
+	return s_ifs[f->backend].f_more(f);
+}
+
+const char *const *
+fsm_cmdout_errors(fsm *f)
 {
-	return s_backend.f_report();
+	return s_ifs[f->backend].f_errors(f);
 }
 
 
-/* Look up backend by name and attach it */
-void
+/* Look up backend by name and attach it; returns its number, which is
+ * what fsm_cmdout_new() wants */
+int
 fsm_cmdout_attach(const char *ifname)
 {
 	for (size_t i = 0; i < COUNTOF(s_backends); i++)
 		if (strcmp(s_backends[i].name, ifname) == 0) {
-			D("attaching '%s', ifname", ifname);
-			s_backends[i].attach_fn(&s_backend);
-			return;
+			D("attaching '%s'", ifname);
+			s_backends[i].attach_fn(&s_ifs[i]);
+			return (int)i;
 		}
 	C("could not find '%s' to attach", ifname);
-	return;
+	return -1;
 }
@@ -15,23 +15,35 @@
 
 /* The backend cmdout-fsm interface and call dispatch struct */
 struct fsm_cmdout_if {
-	fsm *(*f_init)(void);
-	const char *(*f_ps1buf)(void);
-	bool (*f_anykey)(void);
-	bool (*f_report)(void);
-	const char *(*f_outbuf)(void);
-	size_t (*f_outbufcnt)(void);
+	fsm *(*f_new)(void);
+	void (*f_destroy)(fsm *f);
+	const char *(*f_ps1buf)(fsm *f);
+	size_t (*f_ps1bufcnt)(fsm *f);
+	bool (*f_anykey)(fsm *f);
+	bool (*f_report)(fsm *f);
+	const char *(*f_outbuf)(fsm *f);
+	size_t (*f_outbufcnt)(fsm *f);
+	void (*f_outdrop)(fsm *f, size_t n);
+	bool (*f_more)(fsm *f);
+	const char *const *(*f_errors)(fsm *f);
 };
 
 /* This is the interface core uses to talk to whatever backend attached */
-fsm *fsm_cmdout_init(void);
-const char *fsm_cmdout_ps1buf(void);
-const char *fsm_cmdout_outbuf(void);
-size_t fsm_cmdout_outbufcnt(void);
-bool fsm_cmdout_anykey(void);
-bool fsm_cmdout_report(void);
-
-/* Load backend fsm by name */
-void fsm_cmdout_attach(const char *ifname);
+fsm *fsm_cmdout_new(int backend);
+void fsm_cmdout_destroy(fsm *f);
+const char *fsm_cmdout_ps1buf(fsm *f);
+size_t fsm_cmdout_ps1bufcnt(fsm *f);
+const char *fsm_cmdout_outbuf(fsm *f);
+size_t fsm_cmdout_outbufcnt(fsm *f);
+void fsm_cmdout_outdrop(fsm *f, size_t n); /* forget the first n bytes */
+bool fsm_cmdout_anykey(fsm *f);
+bool fsm_cmdout_report(fsm *f);
+bool fsm_cmdout_more(fsm *f); /* pager wants a keypress */
+
+/* NULL-terminated list of what the switch says when it rejects a command */
+const char *const *fsm_cmdout_errors(fsm *f);
+
+/* Load backend fsm by name, returns its number */
+int fsm_cmdout_attach(const char *ifname);
 
 #endif
@@ -32,28 +32,42 @@ static struct fsm_inchar_type {
 #undef X
 };
 
-/* Attach point + call dispatch to whatever backend was attached */
-static struct fsm_inchar_if s_backend;
+/* Attach points + call dispatch, one per backend; those not attached
+ * are all NULL.  Every fsm knows which backend made it */
+static struct fsm_inchar_if s_ifs[COUNTOF(s_backends)];
 
 
-/* Delegate the backend interface to whatever attached to `s_backend` */
+/* Delegate the backend interface to the backend in charge */
 fsm *
-fsm_inchar_init(void)
+fsm_inchar_new(int backend)
 {
-	return s_backend.f_init();
+	fsm *f = s_ifs[backend].f_new();
+	f->backend = backend;
+	return f;
 }
 
-
-/* Look up backend by name and attach it */
 void
+fsm_inchar_destroy(fsm *f)
+{
+	if (!f)
+		return;
+
+	s_ifs[f->backend].f_destroy(f);
+	return;
+}
+
+
+/* Look up backend by name and attach it; returns its number, which is
+ * what fsm_inchar_new() wants */
+int
 fsm_inchar_attach(const char *ifname)
 {
 	for (size_t i = 0; i < COUNTOF(s_backends); i++)
 		if (strcmp(s_backends[i].name, ifname) == 0) {
-			D("attaching '%s', ifname", ifname);
-			s_backends[i].attach_fn(&s_backend);
-			return;
+			D("attaching '%s'", ifname);
+			s_backends[i].attach_fn(&s_ifs[i]);
+			return (int)i;
 		}
 	C("could not find '%s' to attach", ifname);
-	return;
+	return -1;
 }
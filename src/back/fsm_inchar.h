@@ -15,13 +15,15 @@
 
 /* The backend inchar-fsm interface and call dispatch struct */
 struct fsm_inchar_if {
-	fsm *(*f_init)(void);
+	fsm *(*f_new)(void);
+	void (*f_destroy)(fsm *f);
 };
 
 /* This is the interface core uses to talk to whatever backend attached */
-fsm *fsm_inchar_init(void);
+fsm *fsm_inchar_new(int backend);
+void fsm_inchar_destroy(fsm *f);
 
-/* Load backend fsm by name */
-void fsm_inchar_attach(const char *ifname);
+/* Load backend fsm by name, returns its number */
+int fsm_inchar_attach(const char *ifname);
 
 #endif
@@ -32,46 +32,93 @@ static struct fsm_init_type {
 #undef X
 };
 
-/* Attach point + call dispatch to whatever backend was attached */
-static struct fsm_init_if s_backend;
+/* Attach points + call dispatch, one per backend; those not attached
+ * are all NULL.  Every fsm knows which backend made it */
+static struct fsm_init_if s_ifs[COUNTOF(s_backends)];
 
 
-/* Delegate the backend interface to whatever attached to `s_backend` */
+/* Delegate the backend interface to the backend in charge */
 fsm *
-fsm_init_init(void)
+fsm_init_new(int backend)
 {
-	return s_backend.f_init();
+	fsm *f = s_ifs[backend].f_new();
+	f->backend = backend;
+	return f;
+}
+
+void
+fsm_init_destroy(fsm *f)
+{
+	if (!f)
+		return;
+
+	s_ifs[f->backend].f_destroy(f);
+	return;
 }
 
 const char *
-fsm_init_ps1buf(void)
+fsm_init_ps1buf(fsm *f)
 {
-	return s_backend.f_ps1buf();
+	return s_ifs[f->backend].f_ps1buf(f);
+}
+
+size_t
+fsm_init_ps1bufcnt(fsm *f)
+{
+	return s_ifs[f->backend].f_ps1bufcnt(f);
 }
 
 bool
-fsm_init_anykey(void)
+fsm_init_anykey(fsm *f)
 {
-	return s_backend.f_anykey();
+	return s_ifs[f->backend].f_anykey(f);
 }
 
 bool
-fsm_init_report(void)
+fsm_init_report(fsm *f)
+{
+	return s_ifs[f->backend].f_report(f);
+}
+
+const char *
+fsm_init_setup(fsm *f)
 {
-	return s_backend.f_report();
+	return s_ifs[f->backend].f_setup(f);
 }
 
 
-/* Look up backend by name and attach it */
-void
+int
+fsm_init_detect(const uint8_t *data, size_t len)
+{
+	bool maybe = false;
+	for (size_t i = 0; i < COUNTOF(s_ifs); i++) {
+		if (!s_ifs[i].f_detect)
+			continue; /* not attached */
+
+		int r = s_ifs[i].f_detect(data, len);
+		if (r == 1) {
+			D("looks like '%s'", s_backends[i].name);
+			return (int)i;
+		}
+
+		maybe = maybe || r == -1;
+	}
+
+	return maybe ? -1 : -2;
+}
+
+
+/* Look up backend by name and attach it; returns its number, which is
+ * what fsm_init_new() wants */
+int
 fsm_init_attach(const char *ifname)
 {
 	for (size_t i = 0; i < COUNTOF(s_backends); i++)
 		if (strcmp(s_backends[i].name, ifname) == 0) {
-			D("attaching '%s', ifname", ifname);
-			s_backends[i].attach_fn(&s_backend);
-			return;
+			D("attaching '%s'", ifname);
+			s_backends[i].attach_fn(&s_ifs[i]);
+			return (int)i;
 		}
 	C("could not find '%s' to attach", ifname);
-	return;
+	return -1;
 }
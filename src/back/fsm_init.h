@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <sys/types.h>
 
@@ -15,19 +16,32 @@
 
 /* The backend init-fsm interface and call dispatch struct */
 struct fsm_init_if {
-	fsm *(*f_init)(void);
-	const char *(*f_ps1buf)(void);
-	bool (*f_anykey)(void);
-	bool (*f_report)(void);
+	fsm *(*f_new)(void);
+	void (*f_destroy)(fsm *f);
+	const char *(*f_ps1buf)(fsm *f);
+	size_t (*f_ps1bufcnt)(fsm *f);
+	bool (*f_anykey)(fsm *f);
+	bool (*f_report)(fsm *f);
+	const char *(*f_setup)(fsm *f);
+	int (*f_detect)(const uint8_t *data, size_t len);
 };
 
 /* This is the interface core uses to talk to whatever backend attached */
-fsm *fsm_init_init(void);
-const char *fsm_init_ps1buf(void);
-bool fsm_init_anykey(void);
-bool fsm_init_report(void);
-
-/* Load backend fsm by name */
-void fsm_init_attach(const char *ifname);
+fsm *fsm_init_new(int backend);
+void fsm_init_destroy(fsm *f);
+const char *fsm_init_ps1buf(fsm *f);
+size_t fsm_init_ps1bufcnt(fsm *f);
+bool fsm_init_anykey(fsm *f);
+bool fsm_init_report(fsm *f);
+const char *fsm_init_setup(fsm *f); /* commands to issue after login */
+
+/* Load backend fsm by name, returns its number */
+int fsm_init_attach(const char *ifname);
+
+/* Which of the attached backends is `data`, the first thing the switch
+ * said, from?  Each gets to look at it; the first to recognize it wins.
+ * Returns the backend's number, -1 if we need more data to tell, -2 if
+ * none of them recognize it */
+int fsm_init_detect(const uint8_t *data, size_t len);
 
 #endif
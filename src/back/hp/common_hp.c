@@ -10,10 +10,15 @@
 
 #include "common_hp.h"
 
+#include <string.h>
+
 #include "../ansiseq.h"
 #include "../../common/common.h"
 #include "../../common/log.h"
 
+/* what the pager prints when it wants a keypress to show the next page */
+#define MORESTR "-- MORE --"
+
 
 void
 fsm_hp_common_init(void)
@@ -21,9 +26,18 @@ fsm_hp_common_init(void)
 	return;
 }
 
+/* Tokenize for the HP FSMs.  Escape sequences become `t_eseq` and are
+ * stored in `*seq`, the pager prompt becomes `t_more` (pass `t_rest` to not
+ * care about the pager), the rest is `t_rest`.  Returns -1 if we need more
+ * data to decide.
+ * The pager draws its prompt at the start of a line, right after moving
+ * the cursor there, so that's the only place we take MORESTR for it;
+ * anywhere else it's just output.  `*bol` tracks whether we're there
+ * (start out with it true), it may be NULL if t_more is t_rest */
 int
 fsm_hp_mktok(const uint8_t *in, size_t len, size_t *toklen,
-             int t_eseq, int t_rest, int t_eof)
+             struct ansiseq *seq, bool *bol, int t_eseq, int t_more,
+             int t_rest, int t_eof)
 {
 	if (!in)
 		return t_eof;
@@ -34,15 +48,32 @@ fsm_hp_mktok(const uint8_t *in, size_t len, size_t *toklen,
 		C("character out of range: %d", c);
 
 	if (c == '\033') {
-		int r = ansiseq_eatone(in, len, NULL);
-		if (r == -1)
-			return -1;
+		int r = ansiseq_eatone(in, len, seq);
+		if (r < 0)
+			return r;
 
 		*toklen = r;
+		if (bol)
+			*bol = true;
 
 		return t_eseq;
 	}
 
+	if (t_more != t_rest && *bol && c == MORESTR[0]) {
+		size_t n = sizeof MORESTR - 1;
+		if (memcmp(in, MORESTR, len < n ? len : n) == 0) {
+			if (len < n)
+				return -1;
+
+			*toklen = n;
+			*bol = false;
+			return t_more;
+		}
+	}
+
+	if (bol)
+		*bol = c == '\r' || c == '\n';
+
 	*toklen = 1;
 	return t_rest;
 }
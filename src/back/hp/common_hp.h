@@ -5,13 +5,16 @@
 #ifndef BACK_HP_COMMON_HP_H
 #define BACK_HP_COMMON_HP_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include "../ansiseq.h"
 #include "../../common/common.h"
 
 void fsm_hp_common_init(void);
 int fsm_hp_mktok(const uint8_t *in, size_t len, size_t *toklen,
-                 int t_eseq, int t_rest, int t_eof);
+                 struct ansiseq *seq, bool *bol, int t_eseq, int t_more,
+                 int t_rest, int t_eof);
 
 #endif
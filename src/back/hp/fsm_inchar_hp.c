@@ -8,6 +8,7 @@
 
 #define LOG_MOD MOD_BACK_HP_FSM_INCHAR_HP
 
+#include "../act.h"
 #include "../fsm_inchar.h"
 #include "common_hp.h"
 #include "../../common/common.h"
@@ -27,57 +28,41 @@
 #define NUM_TOKENS 3
 
 
-static fsm *s_fsm; /* the actual state machine */
-
-
-static void reset(void);
-static void act_nop(int c);
-static int mktok(const uint8_t *in, size_t len, size_t *toklen);
-static fsm *init(void);
+static int mktok(const uint8_t *in, size_t len, size_t *toklen,
+                 struct ansiseq *seq, bool *bol);
+static fsm *new(void);
 
 /* A table entry {S_FOO, act_bar} at row S_ROW and column T_COL means
  * that if we are in state S_ROW, for an input token T_COL we'll
  * transition to state S_FOO and call act_bar() in the process */
 
-#define ERR {S_ERR, act_nop}
+#define ERR {S_ERR, fsm_nop}
 /* eat the echo we get per input character */
 static struct fsm_trans delta[NUM_STATES * NUM_TOKENS] = {
 /* (inchar) T_ESEQ              T_REST                T_EOF */
-/* S_STA */ {S_CM1, act_nop},   ERR,                  ERR,
-/* S_CM1 */ ERR,                {S_INC, act_nop},     ERR,
-/* S_INC */ {S_CM2, act_nop},   ERR,                  ERR,
-/* S_CM2 */ {S_CM2, act_nop},   ERR,                  {S_FIN, act_nop},
+/* S_STA */ {S_CM1, fsm_nop},   ERR,                  ERR,
+/* S_CM1 */ ERR,                {S_INC, fsm_nop},     ERR,
+/* S_INC */ {S_CM2, fsm_nop},   ERR,                  ERR,
+/* S_CM2 */ {S_CM2, fsm_nop},   ERR,                  {S_FIN, fsm_nop},
 /* S_FIN */ ERR,                ERR,                  ERR,
 /* S_ERR */ ERR,                ERR,                  ERR,
 };
 #undef ERR
 
 
-static void
-reset(void)
-{
-	return;
-}
-
-static void
-act_nop(int c)
-{
-	(void)c;
-	return;
-}
-
 static int
-mktok(const uint8_t *in, size_t len, size_t *toklen)
+mktok(const uint8_t *in, size_t len, size_t *toklen, struct ansiseq *seq,
+      bool *bol)
 {
-	return fsm_hp_mktok(in, len, toklen, T_ESEQ, T_REST, T_EOF);
+	return fsm_hp_mktok(in, len, toklen, seq, bol,
+	                    T_ESEQ, T_REST, T_REST, T_EOF);
 }
 
 static fsm *
-init(void)
+new(void)
 {
-	s_fsm = fsm_new(NUM_STATES, NUM_TOKENS, S_ERR, S_STA,
-	                (int[]){S_FIN}, 1, delta, mktok, reset);
-	return s_fsm;
+	return act_inchar_new(NUM_STATES, NUM_TOKENS, S_ERR, S_STA,
+	                      (int[]){S_FIN}, 1, delta, mktok);
 }
 
 
@@ -85,8 +70,9 @@ void
 fsm_inchar_hp_attach(struct fsm_inchar_if *ifc)
 {
 	/* attach pointers to the above functions to the interface
-	 * struct pointed to by `ifc` */
-	ifc->f_init = init;
+	 * struct pointed to by `ifc`; the rest is act.c's */
+	act_inchar_attach(ifc);
+	ifc->f_new = new;
 	I("fsm_inchar_hp attached");
 	return;
 }
@@ -8,6 +8,9 @@
 
 #define LOG_MOD MOD_BACK_HP_FSM_INIT_HP
 
+#include <string.h>
+
+#include "../act.h"
 #include "../fsm_init.h"
 #include "common_hp.h"
 #include "../../common/common.h"
@@ -31,132 +34,86 @@
 #define T_EOF  2 /* end of data */
 #define NUM_TOKENS 3
 
-#define PS1BUFSZ 256
-
-
-static fsm *s_fsm; /* the actual state machine */
-
-static char *s_ps1buf; /* hold prompt */
-static size_t s_ps1bufsz, s_ps1bufcnt;
+/* issued once logged in; we'd rather not have to deal with the pager */
+#define SETUPCMDS "no page\n"
 
-static bool s_anykey; /* flag - the any key has to be pressed */
-static bool s_report; /* flag - cursor position^W^Wterminal size report */
+/* what gives HP gear away in the banner, see detect() */
+static const char *const s_signatures[] = {
+	"Press any key to continue",
+	"Hewlett",
+	"ProCurve",
+	NULL
+};
 
 
-static void reset(void);
-static void act_nop(int c);
-static void act_ak(int c);
-static void act_report(int c);
-static void act_recps(int c);
-static int mktok(const uint8_t *in, size_t len, size_t *toklen);
-static fsm *init(void);
-static const char *ps1buf(void);
-static bool anykey(void);
-static bool report(void);
+static int mktok(const uint8_t *in, size_t len, size_t *toklen,
+                 struct ansiseq *seq, bool *bol);
+static fsm *new(void);
+static const char *setup(fsm *f);
+static int detect(const uint8_t *data, size_t len);
 
 /* A table entry {S_FOO, act_bar} at row S_ROW and column T_COL means
  * that if we are in state S_ROW, for an input token T_COL we'll
  * transition to state S_FOO and call act_bar() in the process */
 
-#define ERR {S_ERR, act_nop}
+#define ERR {S_ERR, fsm_nop}
 /* eat the initial conversation (license, press the any key, etc) */
 static struct fsm_trans delta[NUM_STATES * NUM_TOKENS] = {
 /* (init)   T_ESEQ              T_REST                T_EOF */
-/* S_STA */ ERR,                {S_LIC, act_nop},     ERR,
-/* S_LIC */ {S_CM1, act_nop},   {S_LIC, act_nop},     ERR,
-/* S_CM1 */ {S_CM1, act_nop},   {S_ANY, act_nop},     ERR,
-/* S_ANY */ {S_CM2, act_ak},    {S_ANY, act_nop},     ERR,
-/* S_CM2 */ {S_CM2, act_nop},   {S_LAS, act_report},  ERR,
-/* S_LAS */ {S_CM3, act_nop},   {S_LAS, act_nop},     ERR,
-/* S_CM3 */ {S_CM3, act_nop},   {S_PS1, act_recps},   ERR,
-/* S_PS1 */ {S_CM4, act_nop},   {S_PS1, act_recps},   ERR,
-/* S_CM4 */ {S_CM4, act_nop},   ERR,                  {S_FIN, act_nop},
+/* S_STA */ ERR,                {S_LIC, fsm_nop},     ERR,
+/* S_LIC */ {S_CM1, fsm_nop},   {S_LIC, fsm_nop},     ERR,
+/* S_CM1 */ {S_CM1, fsm_nop},   {S_ANY, fsm_nop},     ERR,
+/* S_ANY */ {S_CM2, act_ak},    {S_ANY, fsm_nop},     ERR,
+/* S_CM2 */ {S_CM2, fsm_nop},   {S_LAS, act_report},  ERR,
+/* S_LAS */ {S_CM3, fsm_nop},   {S_LAS, fsm_nop},     ERR,
+/* S_CM3 */ {S_CM3, fsm_nop},   {S_PS1, act_initps},  ERR,
+/* S_PS1 */ {S_CM4, fsm_nop},   {S_PS1, act_initps},  ERR,
+/* S_CM4 */ {S_CM4, fsm_nop},   ERR,                  {S_FIN, fsm_nop},
 /* S_FIN */ ERR,                ERR,                  ERR,
 /* S_ERR */ ERR,                ERR,                  ERR,
 };
 #undef ERR
 
 
-static void
-reset(void)
-{
-	s_ps1bufcnt = 0;
-	s_ps1buf[0] = '\0';
-	s_anykey = false;
-	s_report = false;
-	return;
-}
-
-static void
-act_nop(int c)
-{
-	(void)c;
-	return;
-}
-
-static void
-act_ak(int c)
-{
-	(void)c;
-	s_anykey = true;
-	return;
-}
-
-static void
-act_report(int c)
-{
-	(void)c;
-	s_report = true;
-	return;
-}
-
-/* record this character to PS1 buffer */
-static void
-act_recps(int c)
-{
-	if ((s_ps1bufcnt+1) >= s_ps1bufsz)
-		s_ps1buf = xrealloc(s_ps1buf, s_ps1bufsz *= 2);
-
-	s_ps1buf[s_ps1bufcnt++] = c;
-	s_ps1buf[s_ps1bufcnt] = '\0';
-	return;
-}
-
 static int
-mktok(const uint8_t *in, size_t len, size_t *toklen)
+mktok(const uint8_t *in, size_t len, size_t *toklen, struct ansiseq *seq,
+      bool *bol)
 {
-	return fsm_hp_mktok(in, len, toklen, T_ESEQ, T_REST, T_EOF);
+	return fsm_hp_mktok(in, len, toklen, seq, bol,
+	                    T_ESEQ, T_REST, T_REST, T_EOF);
 }
 
 static fsm *
-init(void)
+new(void)
 {
-	s_fsm = fsm_new(NUM_STATES, NUM_TOKENS, S_ERR, S_STA,
-	                (int[]){S_FIN}, 1, delta, mktok, reset);
-	(s_ps1buf = xmalloc(s_ps1bufsz = PS1BUFSZ))[0] = '\0';
-	return s_fsm;
+	return act_init_new(NUM_STATES, NUM_TOKENS, S_ERR, S_STA,
+	                    (int[]){S_FIN}, 1, delta, mktok);
 }
 
 static const char *
-ps1buf(void)
+setup(fsm *f)
 {
-	return s_ps1buf;
+	(void)f;
+	return SETUPCMDS;
 }
 
-static bool
-anykey(void)
+/* the banner names the vendor, and the any key prompt is as good as a
+ * signature.  HP gear never shows a prompt before that, so if there's
+ * one, it's something else */
+static int
+detect(const uint8_t *data, size_t len)
 {
-	bool b = s_anykey;
-	s_anykey = false;
-	return b;
-}
+	for (const char *const *s = s_signatures; *s; s++)
+		if (hasstr(data, len, *s, strlen(*s)))
+			return 1;
 
-static bool
-report(void)
-{
-	bool b = s_report;
-	s_report = false;
-	return b;
+	while (len && data[len-1] == ' ')
+		len--;
+
+	if (len && (data[len-1] == '#' || data[len-1] == '>'))
+		return 0;
+
+	return -1;
 }
 
 
@@ -164,11 +121,11 @@ void
 fsm_init_hp_attach(struct fsm_init_if *ifc)
 {
 	/* attach pointers to the above functions to the interface
-	 * struct pointed to by `ifc` */
-	ifc->f_init = init;
-	ifc->f_ps1buf = ps1buf;
-	ifc->f_anykey = anykey;
-	ifc->f_report = report;
+	 * struct pointed to by `ifc`; the rest is act.c's */
+	act_init_attach(ifc);
+	ifc->f_new = new;
+	ifc->f_setup = setup;
+	ifc->f_detect = detect;
 	I("fsm_init_hp attached");
 	return;
 }
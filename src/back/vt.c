@@ -0,0 +1,565 @@
+/* vt.c - Virtual terminal screen model, renders cursor-addressed output
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_BACK_VT
+
+#include "vt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/common.h"
+#include "../common/log.h"
+
+#define LINEBUFSZ 32 /* initial size of a line, grows up to `cols` */
+#define TABSTOP 8
+
+/* Rows this far above the cursor are taken to be final: they're emitted
+ * and forgotten, so output leaves the screen as it comes rather than
+ * only once it's scrolled off the (possibly huge) screen.  Repaints
+ * reach back a few rows at most */
+#define KEEPROWS 256
+
+/* screen row `ROW`; the screen is a ring so scrolling needn't move lines */
+#define LINE(T, ROW) (&(T)->lines[((T)->base + (ROW)) % (T)->rows])
+
+
+struct vtline {
+	char *buf;
+	int len;    /* columns in use */
+	int sz;     /* bytes allocated for `buf` */
+	bool dirty; /* written to since vt_begin() */
+};
+
+struct vt {
+	int rows, cols;       /* the geometry the other end thinks we have */
+	struct vtline *lines; /* `rows` lines, screen row 0 is lines[base] */
+	int base;
+	int row, col;         /* cursor position */
+	bool wrap;            /* wrote the last column, next char wraps */
+	int srow, scol;       /* saved cursor position */
+	int mtop, mbot;       /* scrolling region */
+	bool emitted;         /* lines have scrolled off since vt_begin() */
+	int top;              /* rows above this one were emitted already */
+	int hi;               /* no row below this one was written to */
+	vt_emit_fn f_emit;
+	void *ctx;
+};
+
+
+static void csi(vt *t, const struct ansiseq *s);
+static int param(const struct ansiseq *s, int i, int def);
+static void moveto(vt *t, int row, int col);
+static void linefeed(vt *t);
+static void revindex(vt *t);
+static void retire(vt *t);
+static void scrollup(vt *t);
+static void scrolldown(vt *t);
+static void eraseline(vt *t, int mode);
+static void erasedisp(vt *t, int mode);
+static void clearline(struct vtline *l);
+static void dropline(struct vtline *l);
+static void putcell(struct vtline *l, int col, int c);
+static void emitline(vt *t, struct vtline *l, bool nl);
+
+
+vt *
+vt_new(int rows, int cols, vt_emit_fn f_emit, void *ctx)
+{
+	vt *t = xmalloc(sizeof *t);
+	t->rows = rows;
+	t->cols = cols;
+	t->f_emit = f_emit;
+	t->ctx = ctx;
+	t->lines = xmalloc(rows * sizeof *t->lines);
+	memset(t->lines, 0, rows * sizeof *t->lines);
+	t->base = 0;
+	t->hi = rows - 1;
+	vt_begin(t);
+	return t;
+}
+
+void
+vt_destroy(vt *t)
+{
+	for (int r = 0; r < t->rows; r++)
+		free(t->lines[r].buf);
+	free(t->lines);
+	free(t);
+	return;
+}
+
+/* only rows up to `hi` can have anything in them; their buffers go, too,
+ * so one big reply doesn't leave its lines allocated for good */
+void
+vt_begin(vt *t)
+{
+	for (int r = 0; r <= t->hi; r++)
+		dropline(LINE(t, r));
+
+	t->base = 0;
+	t->top = t->hi = 0;
+	t->row = t->col = 0;
+	t->srow = t->scol = 0;
+	t->wrap = false;
+	t->mtop = 0;
+	t->mbot = t->rows - 1;
+	t->emitted = false;
+	return;
+}
+
+void
+vt_putc(vt *t, int c)
+{
+	switch (c) {
+	case '\r':
+		t->col = 0;
+		t->wrap = false;
+		return;
+	case '\n':
+	case '\v':
+	case '\f':
+		linefeed(t);
+		t->wrap = false;
+		return;
+	case '\b':
+		if (t->col > 0)
+			t->col--;
+		t->wrap = false;
+		return;
+	case '\t':
+		t->col = (t->col / TABSTOP + 1) * TABSTOP;
+		if (t->col >= t->cols)
+			t->col = t->cols - 1;
+		return;
+	}
+
+	if (c < 0x20 || c == 0x7f)
+		return; /* the remaining controls don't draw anything */
+
+	if (t->wrap) {
+		t->col = 0;
+		linefeed(t);
+		t->wrap = false;
+	}
+
+	/* a repaint reaching back further than KEEPROWS; too late */
+	if (t->row < t->top)
+		D("dropping '%c' for row %d, emitted already", c, t->row);
+	else {
+		putcell(LINE(t, t->row), t->col, c);
+		if (t->row > t->hi)
+			t->hi = t->row;
+	}
+
+	if (t->col == t->cols - 1)
+		t->wrap = true;
+	else
+		t->col++;
+	return;
+}
+
+void
+vt_seq(vt *t, const struct ansiseq *s)
+{
+	if (s->ext)
+		return; /* private modes; nothing we model */
+
+	if (s->cls == '[') {
+		csi(t, s);
+		return;
+	}
+
+	if (s->cls)
+		return; /* charset designation and such */
+
+	switch (s->cmd) {
+	case 'D': /* IND */
+		linefeed(t);
+		break;
+	case 'E': /* NEL */
+		t->col = 0;
+		linefeed(t);
+		break;
+	case 'M': /* RI */
+		revindex(t);
+		break;
+	case '7': /* DECSC */
+		t->srow = t->row;
+		t->scol = t->col;
+		break;
+	case '8': /* DECRC */
+		moveto(t, t->srow, t->scol);
+		break;
+	case 'c': /* RIS */
+		vt_begin(t);
+		break;
+	default:
+		return;
+	}
+
+	t->wrap = false;
+	return;
+}
+
+/* Emit what's on screen, from the first line written to (or the top,
+ * if lines have left the screen already) to the last line written to or
+ * the cursor, whichever is further down.  Lines are newline-terminated,
+ * except for the cursor line if it is the last one. */
+void
+vt_flush(vt *t)
+{
+	int first = -1, last = -1;
+	for (int r = t->top; r <= t->hi; r++)
+		if (LINE(t, r)->dirty) {
+			if (first == -1)
+				first = r;
+			last = r;
+		}
+
+	if (t->emitted)
+		first = t->top;
+
+	if (first == -1)
+		return;
+
+	if (t->row > last)
+		last = t->row;
+
+	for (int r = first; r <= last; r++)
+		emitline(t, LINE(t, r), r != last || r != t->row);
+
+	return;
+}
+
+const char *
+vt_line(vt *t, int row, size_t *len)
+{
+	struct vtline *l = LINE(t, row);
+	*len = l->len;
+	return l->len ? l->buf : "";
+}
+
+void
+vt_dump(vt *t)
+{
+	A("vt %p: %dx%d, cursor at %d,%d (wrap: %d), region %d-%d, "
+	  "base %d, emitted: %d, rows %d-%d", (void *)t, t->rows, t->cols,
+	  t->row, t->col, t->wrap, t->mtop, t->mbot, t->base, t->emitted,
+	  t->top, t->hi);
+	for (int r = t->top; r <= t->hi; r++) {
+		struct vtline *l = LINE(t, r);
+		if (l->len || l->dirty)
+			A("%4d%c '%.*s'", r, l->dirty ? '*' : ' ', l->len,
+			  l->buf);
+	}
+	return;
+}
+
+
+
+static void
+csi(vt *t, const struct ansiseq *s)
+{
+	struct vtline *l;
+	int n = param(s, 0, 1);
+
+	switch (s->cmd) {
+	case 'A': /* CUU */
+		moveto(t, t->row - n, t->col);
+		break;
+	case 'B': /* CUD */
+	case 'e': /* VPR */
+		moveto(t, t->row + n, t->col);
+		break;
+	case 'C': /* CUF */
+	case 'a': /* HPR */
+		moveto(t, t->row, t->col + n);
+		break;
+	case 'D': /* CUB */
+		moveto(t, t->row, t->col - n);
+		break;
+	case 'E': /* CNL */
+		moveto(t, t->row + n, 0);
+		break;
+	case 'F': /* CPL */
+		moveto(t, t->row - n, 0);
+		break;
+	case 'G': /* CHA */
+	case '`': /* HPA */
+		moveto(t, t->row, n - 1);
+		break;
+	case 'd': /* VPA */
+		moveto(t, n - 1, t->col);
+		break;
+	case 'H': /* CUP */
+	case 'f': /* HVP */
+		moveto(t, n - 1, param(s, 1, 1) - 1);
+		break;
+	case 'J': /* ED */
+		erasedisp(t, param(s, 0, 0));
+		break;
+	case 'K': /* EL */
+		eraseline(t, param(s, 0, 0));
+		break;
+	case 'X': /* ECH */
+		l = LINE(t, t->row);
+		for (int c = t->col; c < t->col + n && c < l->len; c++)
+			l->buf[c] = ' ';
+		break;
+	case 'P': /* DCH */
+		l = LINE(t, t->row);
+		if (t->col >= l->len)
+			break;
+		if (n > l->len - t->col)
+			n = l->len - t->col;
+		memmove(l->buf + t->col, l->buf + t->col + n,
+		        l->len - t->col - n);
+		l->len -= n;
+		break;
+	case 'S': /* SU */
+		while (n--)
+			scrollup(t);
+		break;
+	case 'T': /* SD */
+		while (n--)
+			scrolldown(t);
+		break;
+	case 'r': { /* DECSTBM */
+		int top = n - 1, bot = param(s, 1, t->rows) - 1;
+		if (top < bot && bot < t->rows) {
+			t->mtop = top;
+			t->mbot = bot;
+		}
+		moveto(t, 0, 0);
+		break;
+	}
+	case 's': /* SCOSC */
+		t->srow = t->row;
+		t->scol = t->col;
+		break;
+	case 'u': /* SCORC */
+		moveto(t, t->srow, t->scol);
+		break;
+	default:
+		/* SGR, modes, reports, ... don't affect the text */
+		break;
+	}
+	return;
+}
+
+/* `i`th numeric parameter of `s`, or `def` if absent or zero */
+static int
+param(const struct ansiseq *s, int i, int def)
+{
+	if (i >= s->argc || s->argv[i] == ABSENT || s->argv[i] == 0)
+		return def;
+	return s->argv[i];
+}
+
+static void
+moveto(vt *t, int row, int col)
+{
+	t->row = row < 0 ? 0 : row >= t->rows ? t->rows - 1 : row;
+	t->col = col < 0 ? 0 : col >= t->cols ? t->cols - 1 : col;
+	t->wrap = false;
+	retire(t);
+	return;
+}
+
+static void
+linefeed(vt *t)
+{
+	if (t->row == t->mbot)
+		scrollup(t);
+	else if (t->row < t->rows - 1) {
+		t->row++;
+		retire(t);
+	}
+	return;
+}
+
+static void
+revindex(vt *t)
+{
+	if (t->row == t->mtop)
+		scrolldown(t);
+	else if (t->row > 0)
+		t->row--;
+	return;
+}
+
+/* The cursor got KEEPROWS below rows that are still on the screen; those
+ * are final, as good as scrolled off.  Only without a scrolling region,
+ * which would move them around */
+static void
+retire(vt *t)
+{
+	if (t->mtop != 0 || t->mbot != t->rows - 1)
+		return;
+
+	while (t->row - t->top >= KEEPROWS) {
+		struct vtline *l = LINE(t, t->top++);
+		if (l->dirty || t->emitted) {
+			emitline(t, l, true);
+			t->emitted = true;
+		}
+		dropline(l);
+	}
+
+	return;
+}
+
+/* The top line of the scrolling region leaves the screen, so it's final.
+ * Leading blank lines are skipped, everything after them is emitted. */
+static void
+scrollup(vt *t)
+{
+	struct vtline *l = LINE(t, t->mtop);
+	if (t->mtop >= t->top && (l->dirty || t->emitted)) {
+		emitline(t, l, true);
+		t->emitted = true;
+	}
+	dropline(l);
+
+	if (t->mtop == 0 && t->mbot == t->rows - 1) {
+		t->base = (t->base + 1) % t->rows;
+		if (t->top)
+			t->top--;
+		if (t->hi)
+			t->hi--;
+		return;
+	}
+
+	if (t->mbot > t->hi)
+		t->hi = t->mbot;
+
+	struct vtline tmp = *l;
+	for (int r = t->mtop; r < t->mbot; r++)
+		*LINE(t, r) = *LINE(t, r + 1);
+	*LINE(t, t->mbot) = tmp;
+	return;
+}
+
+/* The bottom line of the scrolling region falls off and is lost */
+static void
+scrolldown(vt *t)
+{
+	struct vtline *l = LINE(t, t->mbot);
+	clearline(l);
+
+	if (t->mtop == 0 && t->mbot == t->rows - 1) {
+		t->base = (t->base + t->rows - 1) % t->rows;
+		if (t->hi < t->rows - 1)
+			t->hi++;
+		return;
+	}
+
+	if (t->mbot > t->hi)
+		t->hi = t->mbot;
+
+	struct vtline tmp = *l;
+	for (int r = t->mbot; r > t->mtop; r--)
+		*LINE(t, r) = *LINE(t, r - 1);
+	*LINE(t, t->mtop) = tmp;
+	return;
+}
+
+static void
+eraseline(vt *t, int mode)
+{
+	struct vtline *l = LINE(t, t->row);
+	switch (mode) {
+	case 0:
+		if (t->col < l->len)
+			l->len = t->col;
+		break;
+	case 1:
+		if (l->len)
+			memset(l->buf, ' ', t->col < l->len ? t->col+1 : l->len);
+		break;
+	case 2:
+		l->len = 0;
+		break;
+	}
+	return;
+}
+
+/* whatever is erased from the screen entirely isn't output anymore */
+static void
+erasedisp(vt *t, int mode)
+{
+	switch (mode) {
+	case 0:
+		eraseline(t, 0);
+		for (int r = t->row + 1; r <= t->hi; r++)
+			clearline(LINE(t, r));
+		break;
+	case 1:
+		for (int r = 0; r < t->row; r++)
+			clearline(LINE(t, r));
+		eraseline(t, 1);
+		break;
+	case 2:
+	case 3:
+		for (int r = 0; r <= t->hi; r++)
+			clearline(LINE(t, r));
+		break;
+	}
+	return;
+}
+
+static void
+clearline(struct vtline *l)
+{
+	l->len = 0;
+	l->dirty = false;
+	return;
+}
+
+/* like clearline(), but give back the memory, too */
+static void
+dropline(struct vtline *l)
+{
+	free(l->buf);
+	l->buf = NULL;
+	l->len = l->sz = 0;
+	l->dirty = false;
+	return;
+}
+
+static void
+putcell(struct vtline *l, int col, int c)
+{
+	if (col >= l->sz) {
+		int nsz = l->sz ? l->sz : LINEBUFSZ;
+		while (nsz <= col)
+			nsz *= 2;
+		l->buf = xrealloc(l->buf, nsz);
+		l->sz = nsz;
+	}
+
+	if (col > l->len)
+		memset(l->buf + l->len, ' ', col - l->len);
+
+	l->buf[col] = c;
+	if (col >= l->len)
+		l->len = col + 1;
+	l->dirty = true;
+	return;
+}
+
+static void
+emitline(vt *t, struct vtline *l, bool nl)
+{
+	if (l->len)
+		t->f_emit(t->ctx, l->buf, l->len);
+	if (nl)
+		t->f_emit(t->ctx, "\n", 1);
+	return;
+}
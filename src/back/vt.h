@@ -0,0 +1,37 @@
+/* vt.h - Virtual terminal screen model, renders cursor-addressed output
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef BACK_VT_H
+#define BACK_VT_H
+
+#include <stddef.h>
+
+#include "ansiseq.h"
+
+typedef struct vt vt;
+
+/* Receives rendered text: lines that scroll off the screen (or are far
+ * enough above the cursor to be final, see KEEPROWS in vt.c) as they do,
+ * and whatever is left on the screen when vt_flush() is called */
+typedef void (*vt_emit_fn)(void *ctx, const char *data, size_t len);
+
+vt *vt_new(int rows, int cols, vt_emit_fn f_emit, void *ctx);
+void vt_destroy(vt *t);
+
+/* blank screen, cursor home; call when a new command's output begins */
+void vt_begin(vt *t);
+
+/* feed a character or an escape sequence */
+void vt_putc(vt *t, int c);
+void vt_seq(vt *t, const struct ansiseq *seq);
+
+/* contents of screen row `row`, not NUL-terminated; length in `*len` */
+const char *vt_line(vt *t, int row, size_t *len);
+
+/* emit the part of the screen that has been written to since vt_begin() */
+void vt_flush(vt *t);
+
+void vt_dump(vt *t);
+
+#endif
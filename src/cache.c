@@ -0,0 +1,253 @@
+/* cache.c - Reply cache for idempotent commands; handled by core
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_CACHE
+
+#include "cache.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/common.h"
+#include "common/log.h"
+
+#define NUMBUCKETS 64
+#define MAXRULES 32
+#define MAXCMDLEN 512
+#define MAXCACHESZ (16 * 1024 * 1024) /* total bytes of replies we keep */
+
+
+struct rule {
+	char prefix[MAXCMDLEN]; /* normalized */
+	size_t prefixlen;
+	unsigned long ttl;
+};
+
+struct entry {
+	struct entry *next;
+	char *host;
+	char *cmd;         /* normalized */
+	char *data;
+	size_t len;
+	time_t expires;
+};
+
+static struct rule s_rules[MAXRULES];
+static size_t s_nrules;
+
+static struct entry *s_buckets[NUMBUCKETS];
+static size_t s_cachesz; /* sum of the `len`s of all entries */
+
+
+static const struct rule *findrule(const char *cmd, size_t cmdlen);
+static unsigned hash(const char *host, const char *cmd);
+static void unlink_entry(struct entry **pp);
+static void expire(time_t now);
+static void invalidate(const char *host);
+
+
+void
+cache_init(void)
+{
+	I("cache initialized (%zu rules)", s_nrules);
+	return;
+}
+
+void
+cache_rule(const char *prefix, unsigned long ttl)
+{
+	if (s_nrules == MAXRULES)
+		C("too many cache rules (max %d)", MAXRULES);
+
+	struct rule *r = &s_rules[s_nrules++];
+	r->prefixlen = normcmd(r->prefix, sizeof r->prefix, prefix,
+	                       strlen(prefix));
+	r->ttl = ttl;
+	D("caching '%s' for %lus", r->prefix, ttl);
+	return;
+}
+
+const char *
+cache_get(const char *host, const char *cmd, size_t cmdlen, size_t *len)
+{
+	if (!s_nrules)
+		return NULL;
+
+	char ncmd[MAXCMDLEN];
+	size_t ncmdlen = normcmd(ncmd, sizeof ncmd, cmd, cmdlen);
+	if (!ncmdlen)
+		return NULL;
+
+	const struct rule *r = findrule(ncmd, ncmdlen);
+	if (!r) {
+		invalidate(host);
+		return NULL;
+	}
+
+	time_t now = time(NULL);
+	for (struct entry **pp = &s_buckets[hash(host, ncmd)]; *pp;
+	    pp = &(*pp)->next) {
+		struct entry *e = *pp;
+		if (strcmp(e->cmd, ncmd) != 0 || strcmp(e->host, host) != 0)
+			continue;
+
+		if (e->expires <= now) {
+			D("'%s' on '%s' expired", ncmd, host);
+			unlink_entry(pp);
+			return NULL;
+		}
+
+		D("hit: '%s' on '%s' (%zu bytes)", ncmd, host, e->len);
+		*len = e->len;
+		return e->data;
+	}
+
+	D("miss: '%s' on '%s'", ncmd, host);
+	return NULL;
+}
+
+void
+cache_put(const char *host, const char *cmd, size_t cmdlen,
+          const char *data, size_t len)
+{
+	if (!s_nrules)
+		return;
+
+	char ncmd[MAXCMDLEN];
+	size_t ncmdlen = normcmd(ncmd, sizeof ncmd, cmd, cmdlen);
+	if (!ncmdlen)
+		return;
+
+	const struct rule *r = findrule(ncmd, ncmdlen);
+	if (!r || !r->ttl)
+		return;
+
+	time_t now = time(NULL);
+	if (s_cachesz + len > MAXCACHESZ)
+		expire(now);
+
+	if (s_cachesz + len > MAXCACHESZ) {
+		N("cache full, not caching '%s' (%zu bytes)", ncmd, len);
+		return;
+	}
+
+	struct entry *e = xmalloc(sizeof *e);
+	e->host = xmalloc(strlen(host) + 1);
+	strcpy(e->host, host);
+	e->cmd = xmalloc(ncmdlen + 1);
+	memcpy(e->cmd, ncmd, ncmdlen + 1);
+	e->data = xmalloc(len + 1);
+	memcpy(e->data, data, len);
+	e->data[len] = '\0';
+	e->len = len;
+	e->expires = now + (time_t)r->ttl;
+
+	unsigned h = hash(host, ncmd);
+	e->next = s_buckets[h];
+	s_buckets[h] = e;
+	s_cachesz += len;
+	D("cached '%s' on '%s' (%zu bytes) for %lus", ncmd, host, len, r->ttl);
+	return;
+}
+
+bool
+cache_idempotent(const char *cmd, size_t cmdlen)
+{
+	char ncmd[MAXCMDLEN];
+	size_t ncmdlen = normcmd(ncmd, sizeof ncmd, cmd, cmdlen);
+	return ncmdlen && findrule(ncmd, ncmdlen);
+}
+
+void
+cache_dump(void)
+{
+	A("cache dump (%zu rules, %zu bytes cached)", s_nrules, s_cachesz);
+	for (size_t i = 0; i < s_nrules; i++)
+		A("rule '%s': %lus", s_rules[i].prefix, s_rules[i].ttl);
+	for (size_t i = 0; i < NUMBUCKETS; i++)
+		for (struct entry *e = s_buckets[i]; e; e = e->next)
+			A("[%zu] '%s' on '%s': %zu bytes, expires %lu", i,
+			  e->cmd, e->host, e->len, (unsigned long)e->expires);
+	A("cache end of dump");
+	return;
+}
+
+
+
+/* longest rule that is a whole-word prefix of `cmd` */
+static const struct rule *
+findrule(const char *cmd, size_t cmdlen)
+{
+	const struct rule *best = NULL;
+	for (size_t i = 0; i < s_nrules; i++) {
+		const struct rule *r = &s_rules[i];
+		if (r->prefixlen > cmdlen
+		    || !cmdprefix(r->prefix, r->prefixlen, cmd))
+			continue;
+		if (!best || r->prefixlen > best->prefixlen)
+			best = r;
+	}
+	return best;
+}
+
+/* FNV-1a over host and command */
+static unsigned
+hash(const char *host, const char *cmd)
+{
+	uint32_t h = 2166136261u;
+	for (const char *p = host; *p; p++)
+		h = (h ^ (uint8_t)*p) * 16777619u;
+	h = (h ^ 0) * 16777619u;
+	for (const char *p = cmd; *p; p++)
+		h = (h ^ (uint8_t)*p) * 16777619u;
+	return h % NUMBUCKETS;
+}
+
+static void
+unlink_entry(struct entry **pp)
+{
+	struct entry *e = *pp;
+	*pp = e->next;
+	s_cachesz -= e->len;
+	free(e->host);
+	free(e->cmd);
+	free(e->data);
+	free(e);
+	return;
+}
+
+static void
+expire(time_t now)
+{
+	for (size_t i = 0; i < NUMBUCKETS; i++)
+		for (struct entry **pp = &s_buckets[i]; *pp;)
+			if ((*pp)->expires <= now)
+				unlink_entry(pp);
+			else
+				pp = &(*pp)->next;
+	return;
+}
+
+static void
+invalidate(const char *host)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < NUMBUCKETS; i++)
+		for (struct entry **pp = &s_buckets[i]; *pp;)
+			if (strcmp((*pp)->host, host) == 0) {
+				unlink_entry(pp);
+				n++;
+			} else
+				pp = &(*pp)->next;
+
+	if (n)
+		D("invalidated %zu entries for '%s'", n, host);
+	return;
+}
@@ -0,0 +1,35 @@
+/* cache.h - Reply cache for idempotent commands; handled by core
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+void cache_init(void);
+
+/* Cache replies to commands starting with (the words in) `prefix` for
+ * `ttl` seconds.  The longest matching prefix wins.  A ttl of 0 means
+ * "don't cache, but it's harmless".  Commands that match no rule at all
+ * are assumed to change state and invalidate the host's cache entries */
+void cache_rule(const char *prefix, unsigned long ttl);
+
+/* Look up the reply to `cmd` (as entered, i.e. not normalized) on `host`.
+ * Returns NULL on a miss, otherwise the reply, its length in `*len`.
+ * As a side effect, this drops everything cached for `host` if `cmd`
+ * isn't known to be idempotent. */
+const char *cache_get(const char *host, const char *cmd, size_t cmdlen,
+                      size_t *len);
+
+/* Remember `data` as the reply to `cmd` on `host`, if there's a rule */
+void cache_put(const char *host, const char *cmd, size_t cmdlen,
+               const char *data, size_t len);
+
+/* Is `cmd` known not to change state, i.e. does any rule match it? */
+bool cache_idempotent(const char *cmd, size_t cmdlen);
+
+void cache_dump(void);
+
+#endif
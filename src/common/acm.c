@@ -0,0 +1,186 @@
+/* acm.c - Aho-Corasick matcher, many strings in one pass over a stream
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_COMMON_ACM
+
+#include "acm.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "log.h"
+
+#define NUMNODES 16
+#define NOID SIZE_MAX
+
+
+/* Node 0 is the root, i.e. nothing matched so far.  Until we're compiled,
+ * `delta` is the trie (0: no edge, as nothing leads back to the root);
+ * afterwards it's the complete DFA, failure links folded in. */
+struct node {
+	size_t id;   /* the pattern ending here, NOID if none */
+	size_t fail; /* longest proper suffix of ours that's a node, too */
+	size_t dict; /* nearest node along `fail` that has an id, 0: none */
+};
+
+struct acm {
+	struct node *nodes;
+	uint32_t *delta; /* 256 per node */
+	size_t nnodes, nodessz;
+	size_t npats;
+	bool compiled;
+};
+
+
+static size_t newnode(acm *a);
+
+
+acm *
+acm_new(void)
+{
+	acm *a = xmalloc(sizeof *a);
+	a->nodes = xmalloc((a->nodessz = NUMNODES) * sizeof *a->nodes);
+	a->delta = xmalloc(a->nodessz * 256 * sizeof *a->delta);
+	a->nnodes = a->npats = 0;
+	a->compiled = false;
+	newnode(a);
+	return a;
+}
+
+void
+acm_destroy(acm *a)
+{
+	if (!a)
+		return;
+
+	free(a->nodes);
+	free(a->delta);
+	free(a);
+	return;
+}
+
+size_t
+acm_add(acm *a, const char *pat, size_t len)
+{
+	if (a->compiled)
+		C("adding a pattern to a compiled matcher");
+
+	if (!len)
+		C("empty pattern");
+
+	size_t n = 0;
+	for (size_t i = 0; i < len; i++) {
+		uint32_t *d = &a->delta[n*256 + (unsigned char)pat[i]];
+		if (!*d) {
+			size_t m = newnode(a);
+			/* newnode() may have moved `delta` */
+			d = &a->delta[n*256 + (unsigned char)pat[i]];
+			*d = (uint32_t)m;
+		}
+		n = *d;
+	}
+
+	if (a->nodes[n].id == NOID)
+		a->nodes[n].id = a->npats++;
+
+	return a->nodes[n].id;
+}
+
+size_t
+acm_count(const acm *a)
+{
+	return a->npats;
+}
+
+/* breadth-first, so a node's failure link (which is shallower) is done
+ * by the time we get to it */
+void
+acm_compile(acm *a)
+{
+	if (a->compiled)
+		return;
+
+	size_t *queue = xmalloc(a->nnodes * sizeof *queue);
+	size_t head = 0, tail = 0;
+
+	for (int c = 0; c < 256; c++) {
+		size_t v = a->delta[c];
+		if (v) {
+			a->nodes[v].fail = a->nodes[v].dict = 0;
+			queue[tail++] = v;
+		}
+	}
+
+	while (head < tail) {
+		size_t u = queue[head++];
+		size_t uf = a->nodes[u].fail;
+		for (int c = 0; c < 256; c++) {
+			uint32_t *d = &a->delta[u*256 + c];
+			if (!*d) {
+				*d = a->delta[uf*256 + c];
+				continue;
+			}
+
+			struct node *v = &a->nodes[*d];
+			v->fail = a->delta[uf*256 + c];
+			struct node *vf = &a->nodes[v->fail];
+			v->dict = vf->id != NOID ? v->fail : vf->dict;
+			queue[tail++] = *d;
+		}
+	}
+
+	free(queue);
+	a->compiled = true;
+	D("compiled %zu patterns into %zu states", a->npats, a->nnodes);
+	return;
+}
+
+size_t
+acm_scan(const acm *a, size_t state, const char *data, size_t len,
+         acm_match_fn f, void *ctx)
+{
+	if (!a->compiled)
+		C("scanning with a matcher that isn't compiled");
+
+	const uint32_t *delta = a->delta;
+	const struct node *nodes = a->nodes;
+	size_t n = state;
+	for (size_t i = 0; i < len; i++) {
+		n = delta[n*256 + (unsigned char)data[i]];
+		if (nodes[n].id == NOID && !nodes[n].dict)
+			continue;
+
+		for (size_t m = n; m; m = nodes[m].dict)
+			if (nodes[m].id != NOID)
+				f(ctx, nodes[m].id, i + 1);
+	}
+
+	return n;
+}
+
+
+
+static size_t
+newnode(acm *a)
+{
+	if (a->nnodes == a->nodessz) {
+		a->nodessz *= 2;
+		a->nodes = xrealloc(a->nodes, a->nodessz * sizeof *a->nodes);
+		a->delta = xrealloc(a->delta,
+		                    a->nodessz * 256 * sizeof *a->delta);
+	}
+
+	size_t n = a->nnodes++;
+	a->nodes[n].id = NOID;
+	a->nodes[n].fail = a->nodes[n].dict = 0;
+	memset(&a->delta[n*256], 0, 256 * sizeof *a->delta);
+	return n;
+}
@@ -0,0 +1,38 @@
+/* acm.h - Aho-Corasick matcher, many strings in one pass over a stream
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef COMMON_ACM_H
+#define COMMON_ACM_H
+
+#include <stddef.h>
+
+typedef struct acm acm;
+
+/* The patterns are compiled into a DFA, so scanning looks at every byte
+ * exactly once, however many patterns there are.  The scan state is the
+ * caller's (0 to start), which is how a scan resumes across chunks, and
+ * how one acm serves any number of streams */
+
+/* A match of pattern `id` ends just before `data[end]`, where `data` is
+ * what's being scanned; it may well have started in an earlier chunk */
+typedef void (*acm_match_fn)(void *ctx, size_t id, size_t end);
+
+acm *acm_new(void);
+void acm_destroy(acm *a);
+
+/* Returns the id of `pat` (0, 1, ... in the order added; adding the same
+ * pattern twice gives the same id).  Not after acm_compile() */
+size_t acm_add(acm *a, const char *pat, size_t len);
+
+size_t acm_count(const acm *a);
+
+void acm_compile(acm *a);
+
+/* Scan `data` from `state`, calling `f` for every match in the order the
+ * matches end (for matches ending at the same byte, longest first).
+ * Returns the state to continue from with the next chunk */
+size_t acm_scan(const acm *a, size_t state, const char *data, size_t len,
+                acm_match_fn f, void *ctx);
+
+#endif
@@ -0,0 +1,176 @@
+/* arena.c - Bump allocator for short-lived, per-command buffers
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_COMMON_ARENA
+
+#include "arena.h"
+
+#include <string.h>
+
+#include "common.h"
+#include "log.h"
+
+/* we only ever store byte buffers and pointers in here */
+#define ALIGNSZ (sizeof (void *))
+#define ALIGN(N) (((N) + ALIGNSZ - 1) & ~(size_t)(ALIGNSZ - 1))
+
+
+struct chunk {
+	struct chunk *next;  /* next older chunk */
+	size_t sz;           /* usable bytes in `data` */
+	size_t used;         /* bytes handed out from `data` */
+	unsigned char data[];
+};
+
+struct arena {
+	struct chunk *cur;   /* chunk we're currently carving from */
+	size_t chunksz;      /* minimum chunk size */
+	size_t keepsz;       /* upper bound for what survives a reset */
+	size_t hwm;          /* bytes handed out since the last reset */
+	void *top;           /* most recent allocation (can grow in place) */
+};
+
+
+static struct chunk *newchunk(size_t sz);
+
+
+arena *
+arena_new(size_t chunksz, size_t keepsz)
+{
+	arena *a = xmalloc(sizeof *a);
+	a->chunksz = ALIGN(chunksz);
+	a->keepsz = keepsz < a->chunksz ? a->chunksz : keepsz;
+	a->cur = newchunk(a->chunksz);
+	a->hwm = 0;
+	a->top = NULL;
+	return a;
+}
+
+void
+arena_destroy(arena *a)
+{
+	while (a->cur) {
+		struct chunk *c = a->cur->next;
+		free(a->cur);
+		a->cur = c;
+	}
+	free(a);
+	return;
+}
+
+/* hand out `n` bytes; they live until the next arena_reset() */
+void *
+arena_alloc(arena *a, size_t n)
+{
+	n = ALIGN(n);
+	if (a->cur->sz - a->cur->used < n) {
+		size_t nsz = a->cur->sz * 2;
+		while (nsz < n)
+			nsz *= 2;
+
+		V("new chunk of %zu bytes", nsz);
+		struct chunk *c = newchunk(nsz);
+		c->next = a->cur;
+		a->cur = c;
+	}
+
+	void *p = a->cur->data + a->cur->used;
+	a->cur->used += n;
+	a->hwm += n;
+	a->top = p;
+	return p;
+}
+
+/* like realloc(3), but grows in place if `p` is the most recent allocation
+ * and the current chunk has room, which is the common case for a buffer
+ * that is being appended to.  If `p` has the current chunk all to itself,
+ * the chunk is realloc(3)ed instead, so huge buffers get moved by the
+ * allocator (typically mremap(2)) rather than copied by us */
+void *
+arena_grow(arena *a, void *p, size_t oldsz, size_t newsz)
+{
+	if (p && p == a->top) {
+		size_t off = (size_t)((unsigned char *)p - a->cur->data);
+		size_t have = a->cur->used - off;
+		if (off + ALIGN(newsz) <= a->cur->sz) {
+			a->cur->used = off + ALIGN(newsz);
+			a->hwm = a->hwm - have + ALIGN(newsz);
+			return p;
+		}
+
+		if (off == 0) {
+			size_t nsz = a->cur->sz * 2;
+			while (nsz < ALIGN(newsz))
+				nsz *= 2;
+
+			V("resizing sole-tenant chunk to %zu bytes", nsz);
+			a->cur = xrealloc(a->cur, sizeof *a->cur + nsz);
+			a->cur->sz = nsz;
+			a->cur->used = ALIGN(newsz);
+			a->hwm = a->hwm - have + ALIGN(newsz);
+			return a->top = a->cur->data;
+		}
+	}
+
+	void *np = arena_alloc(a, newsz);
+	if (p)
+		memcpy(np, p, oldsz < newsz ? oldsz : newsz);
+	return np;
+}
+
+/* Throw away all allocations.  If the last cycle needed more than the
+ * current chunk, replace the chunk list by a single chunk that is big
+ * enough for the high-water mark, but no bigger than `keepsz`.  This way
+ * a repeated big command settles on one chunk, while a one-off huge one
+ * doesn't leave us with a permanently bloated footprint. */
+void
+arena_reset(arena *a)
+{
+	if (a->cur->next) {
+		size_t nsz = a->hwm;
+		if (nsz < a->chunksz)
+			nsz = a->chunksz;
+		if (nsz > a->keepsz)
+			nsz = a->keepsz;
+
+		D("trimming to %zu bytes (hwm was %zu)", nsz, a->hwm);
+		while (a->cur) {
+			struct chunk *c = a->cur->next;
+			free(a->cur);
+			a->cur = c;
+		}
+		a->cur = newchunk(nsz);
+	}
+
+	a->cur->used = 0;
+	a->hwm = 0;
+	a->top = NULL;
+	return;
+}
+
+void
+arena_dump(arena *a)
+{
+	A("arena %p: chunksz=%zu, keepsz=%zu, hwm=%zu", (void *)a,
+	  a->chunksz, a->keepsz, a->hwm);
+	for (struct chunk *c = a->cur; c; c = c->next)
+		A("chunk %p: sz=%zu, used=%zu", (void *)c, c->sz, c->used);
+	return;
+}
+
+
+
+static struct chunk *
+newchunk(size_t sz)
+{
+	struct chunk *c = xmalloc(sizeof *c + sz);
+	c->next = NULL;
+	c->sz = sz;
+	c->used = 0;
+	return c;
+}
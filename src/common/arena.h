@@ -0,0 +1,25 @@
+/* arena.h - Bump allocator for short-lived, per-command buffers
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef COMMON_ARENA_H
+#define COMMON_ARENA_H
+
+#include <stddef.h>
+
+typedef struct arena arena;
+
+/* `chunksz` is the size of the first chunk, `keepsz` is the most we hold on
+ * to across arena_reset(), anything beyond is given back */
+arena *arena_new(size_t chunksz, size_t keepsz);
+void arena_destroy(arena *a);
+
+void *arena_alloc(arena *a, size_t n);
+void *arena_grow(arena *a, void *p, size_t oldsz, size_t newsz);
+
+/* invalidate everything allocated so far, trim to the high-water mark */
+void arena_reset(arena *a);
+
+void arena_dump(arena *a);
+
+#endif
@@ -10,8 +10,10 @@
 
 #include "common.h"
 
+#include <errno.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <ctype.h>
 #include <signal.h>
@@ -19,6 +21,7 @@
 #include <time.h>
 
 #include <fcntl.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <sys/select.h>
 #include <sys/time.h>
@@ -26,7 +29,7 @@
 #include "log.h"
 
 
-static void ywrite(int fd, const char *data, size_t len, bool transscribe);
+static bool ywrite(int fd, const char *data, size_t len, bool transscribe);
 
 
 /* shift data to the left by `n` elements */
@@ -56,6 +59,152 @@ growbuf(char **buf, size_t *bufsz, size_t minsz)
 	return;
 }
 
+/* give memory back if buffer `*buf` has grown beyond `maxsz` bytes. it is
+ * shrunk to `minsz` bytes, or less aggressively if it still holds more
+ * than that (`cnt` bytes of content, plus room for a terminator) */
+void
+trimbuf(char **buf, size_t *bufsz, size_t cnt, size_t minsz, size_t maxsz)
+{
+	if (*bufsz <= maxsz)
+		return;
+
+	size_t nsz = minsz;
+	while (nsz <= cnt)
+		nsz *= 2;
+
+	if (nsz >= *bufsz)
+		return;
+
+	D("trimming buffer from %zu to %zu bytes", *bufsz, nsz);
+	*buf = xrealloc(*buf, nsz);
+	*bufsz = nsz;
+	return;
+}
+
+/* strip leading and trailing whitespace (including the newline) off a
+ * command and squeeze the rest, so "show  vlans \r\n" and "show vlans"
+ * are the same.  returns the length, or 0 if it's empty or doesn't fit */
+size_t
+normcmd(char *dest, size_t destsz, const char *cmd, size_t cmdlen)
+{
+	size_t n = 0;
+	bool space = false;
+	for (size_t i = 0; i < cmdlen; i++) {
+		char c = cmd[i];
+		if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			space = n > 0;
+			continue;
+		}
+
+		if (n + space + 1 >= destsz)
+			return 0;
+
+		if (space)
+			dest[n++] = ' ';
+		dest[n++] = c;
+		space = false;
+	}
+
+	dest[n] = '\0';
+	return n;
+}
+
+/* tell if the first `prefixlen` chars of (normalized) command `cmd` are
+ * `prefix` and end at a word boundary, i.e. "show" is a prefix of
+ * "show vlans" but not of "showtime" */
+bool
+cmdprefix(const char *prefix, size_t prefixlen, const char *cmd)
+{
+	return strncmp(cmd, prefix, prefixlen) == 0
+	    && (cmd[prefixlen] == ' ' || cmd[prefixlen] == '\0');
+}
+
+/* break `line` up into at most `maxwords` words, in place, for the
+ * def backend's and fleet's script files.  Words are separated by
+ * blanks, '#' starts a comment, and double-quoted ones (`quoted[i]`)
+ * may contain blanks and know \n, \r, \t, \e, \\ and \".  The number of
+ * words goes to `*nw`.  false if the line is no good; why is then in
+ * `err`, for the caller to report */
+bool
+splitwords(char *line, char **w, bool *quoted, size_t maxwords,
+           size_t *nw, char *err, size_t errsz)
+{
+	*nw = 0;
+	char *p = line;
+	for (;;) {
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+			p++;
+		if (!*p || *p == '#')
+			break;
+
+		if (*nw == maxwords) {
+			snprintf(err, errsz, "too many words");
+			return false;
+		}
+
+		if (*p != '"') {
+			quoted[*nw] = false;
+			w[(*nw)++] = p;
+			while (*p && !strchr(" \t\r\n", *p))
+				p++;
+			if (*p)
+				*p++ = '\0';
+			continue;
+		}
+
+		quoted[*nw] = true;
+		char *d = w[(*nw)++] = ++p;
+		for (;; p++) {
+			if (!*p || *p == '\n') {
+				snprintf(err, errsz, "unterminated string");
+				return false;
+			}
+			if (*p == '"')
+				break;
+			if (*p != '\\') {
+				*d++ = *p;
+				continue;
+			}
+
+			switch (*++p) {
+			case 'n': *d++ = '\n'; break;
+			case 'r': *d++ = '\r'; break;
+			case 't': *d++ = '\t'; break;
+			case 'e': *d++ = '\033'; break;
+			case '\\': *d++ = '\\'; break;
+			case '"': *d++ = '"'; break;
+			default:
+				snprintf(err, errsz, "bad escape '\\%c'", *p);
+				return false;
+			}
+		}
+		*d = '\0';
+		p++;
+	}
+
+	return true;
+}
+
+/* tell if `needle` occurs anywhere in `hay` */
+bool
+hasstr(const void *hay, size_t haylen, const char *needle,
+       size_t needlelen)
+{
+	if (needlelen > haylen)
+		return false;
+
+	const char *end = (const char *)hay + haylen - needlelen + 1;
+	for (const char *p = hay; p < end; p++) {
+		p = memchr(p, needle[0], end - p);
+		if (!p)
+			return false;
+		if (memcmp(p, needle, needlelen) == 0)
+			return true;
+	}
+
+	return false;
+}
+
 /* tell if a fd is readable, optionally wait until it is
  * returns 1: readable, 0: not readable (cannot happen if `block` is true)
  * panics on error */
@@ -89,6 +238,37 @@ selectfd(int fd, bool block)
 	return 1;
 }
 
+/* wait at most `ms` millisecs (forever if negative) for a fd to become
+ * readable.  returns 1: readable, 0: timed out.  panics on error */
+int
+waitfd(int fd, long ms)
+{
+	if (ms < 0)
+		return selectfd(fd, true);
+
+	uint64_t until = timestamp_ms() + (unsigned long)ms;
+	for (;;) {
+		struct timeval tv = {ms / 1000, (ms % 1000) * 1000};
+		fd_set fds;
+		FD_ZERO(&fds);
+		if (fd >= 0) FD_SET(fd, &fds);
+		D("waiting up to %ld ms for fd %d to become readable", ms, fd);
+		int r = select(fd+1, &fds, NULL, NULL, &tv);
+
+		if (r == -1) {
+			if (errno != EINTR)
+				CE("select");
+
+			WE("select");
+			uint64_t now = timestamp_ms();
+			ms = until > now ? (long)(until - now) : 0;
+			continue;
+		}
+
+		return r;
+	}
+}
+
 /* wrapper around malloc(3), panics on error */
 void *
 xmalloc(size_t n)
@@ -110,17 +290,33 @@ xrealloc(void *p, size_t n)
 	return r;
 }
 
-/* Like ywrite with transcription enabled */
-void
+/* strdup(3) that panics on failure, like xmalloc() */
+char *
+xstrdup(const char *s)
+{
+	size_t n = strlen(s) + 1;
+	return memcpy(xmalloc(n), s, n);
+}
+
+/* Like ywrite with transcription enabled.  true if everything was
+ * written, false on error (with errno set) */
+bool
 xwrite(int fd, const char *data, size_t len)
 {
-	ywrite(fd, data, len, true);
-	return;
+	return ywrite(fd, data, len, true);
 }
 
-/* Wrapper around read(2), panics on both error and EOF (for now, XXX),
- * but not on EAGAIN.  Restarts the call on EINTR (for now XXX)
- * returns the number of bytes read (> 0) or -1 on EAGAIN */
+/* Like ywrite without transcription, for data that isn't talk with a
+ * switch or the user (e.g. to files) */
+bool
+xwrite_raw(int fd, const char *data, size_t len)
+{
+	return ywrite(fd, data, len, false);
+}
+
+/* Wrapper around read(2) that restarts the call on EINTR (for now XXX)
+ * and transcribes what it read.  Returns the number of bytes read, 0 on
+ * EOF, -1 on error and EAGAIN (with errno set) */
 ssize_t
 xread(int fd, void *dest, size_t destsz)
 {
@@ -134,14 +330,14 @@ xread(int fd, void *dest, size_t destsz)
 				WE("read");
 				continue;
 			}
-			if (errno != EAGAIN) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				int e = errno;
 				tscribe(tsnam, "[READ ERROR]", 12, true);
-				CE("read");
+				errno = e;
 			}
-		} else if (r == 0) {
+		} else if (r == 0)
 			tscribe(tsnam, "[EOF]", 5, true);
-			C("read: EOF"); // XXX
-		} else
+		else
 			tscribe(tsnam, dest, r, true);
 
 		break;
@@ -155,13 +351,17 @@ void
 tscribe(const char *name, const char *data, size_t len, bool reading)
 {
 	char path[256];
+	static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
 	static unsigned long s_seq;
+	pthread_mutex_lock(&s_lock);
+	unsigned long seq = s_seq++;
+	pthread_mutex_unlock(&s_lock);
 	struct timeval tv;
 	if (gettimeofday(&tv, NULL) == -1)
 		CE("gettimeofday");
 	char timestr[32];
 	snprintf(timestr, sizeof timestr, "%"PRIu64".%04u/%lu: ",
-	    (uint64_t)tv.tv_sec, (unsigned)(tv.tv_usec / 1000u), s_seq++);
+	    (uint64_t)tv.tv_sec, (unsigned)(tv.tv_usec / 1000u), seq);
 	snprintf(path, sizeof path, "/tmp/transcript.%s", name);
 	int fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0700);
 	if (fd == -1)
@@ -194,6 +394,40 @@ msleep(unsigned long ms)
 	return;
 }
 
+/* milliseconds on a clock that doesn't jump, for measuring intervals */
+uint64_t
+timestamp_ms(void)
+{
+	struct timespec ts;
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		CE("clock_gettime");
+	return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+/* how long to wait before the `n`th (from 1) retry: `base` doubled for
+ * each one before it, up to `max`, then randomly cut by up to half so
+ * that things failing together don't retry together */
+unsigned long
+backoff_ms(unsigned n, unsigned long base, unsigned long max)
+{
+	unsigned long ms = base;
+	for (unsigned i = 1; i < n && ms < max; i++)
+		ms *= 2;
+	if (ms > max)
+		ms = max;
+
+	/* fleet's workers back off concurrently */
+	static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+	static unsigned s_seed;
+	pthread_mutex_lock(&s_lock);
+	if (!s_seed)
+		s_seed = (unsigned)(timestamp_ms() ^ (uint64_t)getpid()) | 1u;
+	unsigned long cut = (unsigned long)rand_r(&s_seed) % (ms / 2 + 1);
+	pthread_mutex_unlock(&s_lock);
+
+	return ms - cut;
+}
+
 /* enable or disable blocking mode on fd `fd` */
 void
 setblocking(int fd, bool blocking)
@@ -212,6 +446,40 @@ setblocking(int fd, bool blocking)
 	return;
 }
 
+/* a read-write file in $TMPDIR that's unlinked already, so nobody else
+ * can get at it and it's gone with the last descriptor; -1 on error */
+int
+tmpfd(void)
+{
+	/* no mkstemp() at our POSIX level; O_EXCL is what makes it safe */
+	static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+	static unsigned long s_seq;
+
+	const char *tmp = getenv("TMPDIR");
+	char path[256];
+	for (;;) {
+		pthread_mutex_lock(&s_lock);
+		unsigned long seq = s_seq++;
+		pthread_mutex_unlock(&s_lock);
+
+		snprintf(path, sizeof path, "%s/swh.%ld.%lu.%llu",
+		         tmp && *tmp ? tmp : "/tmp", (long)getpid(), seq,
+		         (unsigned long long)timestamp_ms());
+
+		int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd == -1) {
+			if (errno == EEXIST)
+				continue;
+			WE("open %s", path);
+			return -1;
+		}
+
+		if (unlink(path) != 0)
+			WE("unlink %s", path);
+		return fd;
+	}
+}
+
 /* prints nothing at all, unless the verbosity level is pushed all
  * the way up to the hex-level (-vvvvv), in which case it prints
  * pretty hexdumps in hexdump(1) -C style */
@@ -279,11 +547,12 @@ hexdump(const void *data, size_t len, const char *name)
 
 
 /* Wrapper around write(2), won't stop until `len` bytes are written,
- * panics on error, optionally transscribes written data to a files.
+ * returns false on error (with errno set), optionally transscribes
+ * written data to a files.
  * This function exists because the transcribe function itself uses
  * this interface and thus needs a way to disable transcribing while
  * writing the transcript. */
-static void
+static bool
 ywrite(int fd, const char *data, size_t len, bool transscribe)
 {
 	char tsnam[16];
@@ -297,18 +566,22 @@ ywrite(int fd, const char *data, size_t len, bool transscribe)
 				WE("write");
 				continue;
 			}
+			int e = errno;
+			WE("write");
 			if (transscribe)
 				tscribe(tsnam, "[WRITE ERR]", 13, false);
-			CE("write");
+			errno = e;
+			return false;
 		} else if (r == 0) {
 			if (transscribe)
 				tscribe(tsnam, "[WRITE 0]", 9, false);
-			C("write: 0");
+			errno = EIO;
+			return false;
 		}
 		if (transscribe)
 			tscribe(tsnam, data + bc, (size_t)r, false);
 		V("wrote %zd bytes to fd %d", r, fd);
 		bc += (size_t)r;
 	}
-	return;
+	return true;
 }
@@ -7,6 +7,7 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #include <sys/types.h>
 
@@ -14,14 +15,28 @@
 
 void shiftbuf(char *buf, size_t *bufcnt, size_t n);
 void growbuf(char **buf, size_t *bufsz, size_t minsz);
+void trimbuf(char **buf, size_t *bufsz, size_t cnt, size_t minsz,
+             size_t maxsz);
+size_t normcmd(char *dest, size_t destsz, const char *cmd, size_t cmdlen);
+bool cmdprefix(const char *prefix, size_t prefixlen, const char *cmd);
+bool splitwords(char *line, char **w, bool *quoted, size_t maxwords,
+                size_t *nw, char *err, size_t errsz);
+bool hasstr(const void *hay, size_t haylen, const char *needle,
+            size_t needlelen);
 int selectfd(int fd, bool block);
+int waitfd(int fd, long ms);
 void *xmalloc(size_t n);
 void *xrealloc(void *p, size_t n);
-void xwrite(int fd, const char *data, size_t len);
+char *xstrdup(const char *s);
+bool xwrite(int fd, const char *data, size_t len);
+bool xwrite_raw(int fd, const char *data, size_t len);
 ssize_t xread(int fd, void *dest, size_t destsz);
 void tscribe(const char *name, const char *data, size_t len, bool reading);
 void msleep(unsigned long ms);
+uint64_t timestamp_ms(void);
+unsigned long backoff_ms(unsigned n, unsigned long base, unsigned long max);
 void setblocking(int fd, bool blocking);
+int tmpfd(void);
 void hexdump(const void *data, size_t len, const char *name);
 
 #endif
@@ -133,8 +133,11 @@ log_log(int mod, int lvl, int errn, const char *file, int line,
 	}
 
 	if (always) {
+		/* in one piece, even with other threads logging */
+		flockfile(stderr);
 		fputs(payload, stderr);
 		fputs("\n", stderr);
+		funlockfile(stderr);
 	} else {
 		char pad[256];
 		if (lvl == LOG_TRACE) {
@@ -0,0 +1,207 @@
+/* spill.c - Append-only buffer that moves to a temporary file when big
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_COMMON_SPILL
+
+#include "spill.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "common.h"
+#include "log.h"
+
+#define BUFSZ 4096
+
+/* once spilled, appends are gathered in a buffer this big before they
+ * go to the file */
+#define STAGESZ (64 * 1024)
+
+#define DEF_THRESHOLD (16 * 1024 * 1024)
+
+
+struct spill {
+	char *buf;  /* everything, or what's not in the file yet */
+	size_t bufsz, bufcnt;
+	int fd;     /* -1 unless spilled */
+	bool stuck; /* couldn't spill, don't try again */
+	size_t len; /* all of it, file and buf */
+
+	void *map;  /* handed out by spill_view(), if spilled */
+	size_t mapsz;
+};
+
+
+static size_t s_threshold = DEF_THRESHOLD;
+
+
+static bool spillout(spill *sp);
+static bool flush(spill *sp);
+static void unmap(spill *sp);
+
+
+void
+spill_threshold(size_t bytes)
+{
+	s_threshold = bytes;
+	return;
+}
+
+spill *
+spill_new(void)
+{
+	spill *sp = xmalloc(sizeof *sp);
+	(sp->buf = xmalloc(sp->bufsz = BUFSZ))[0] = '\0';
+	sp->bufcnt = sp->len = 0;
+	sp->fd = -1;
+	sp->stuck = false;
+	sp->map = NULL;
+	sp->mapsz = 0;
+	return sp;
+}
+
+void
+spill_destroy(spill *sp)
+{
+	if (!sp)
+		return;
+
+	unmap(sp);
+	if (sp->fd != -1)
+		close(sp->fd);
+	free(sp->buf);
+	free(sp);
+	return;
+}
+
+bool
+spill_append(spill *sp, const void *data, size_t len)
+{
+	if (sp->fd == -1 && !sp->stuck && s_threshold
+	    && sp->len + len > s_threshold && !spillout(sp)) {
+		W("keeping %zu bytes in memory after all", sp->len + len);
+		sp->stuck = true;
+	}
+
+	if (sp->fd != -1 && sp->bufcnt + len > STAGESZ) {
+		if (!flush(sp))
+			return false;
+
+		/* too big to bother gathering */
+		if (len > STAGESZ) {
+			if (!xwrite_raw(sp->fd, data, len))
+				return false;
+			sp->len += len;
+			return true;
+		}
+	}
+
+	growbuf(&sp->buf, &sp->bufsz, sp->bufcnt + len + 1);
+	memcpy(sp->buf + sp->bufcnt, data, len);
+	sp->bufcnt += len;
+	sp->buf[sp->bufcnt] = '\0';
+	sp->len += len;
+	return true;
+}
+
+void
+spill_reset(spill *sp)
+{
+	unmap(sp);
+	if (sp->fd != -1) {
+		close(sp->fd);
+		sp->fd = -1;
+	}
+
+	trimbuf(&sp->buf, &sp->bufsz, 0, BUFSZ, BUFSZ);
+	sp->buf[sp->bufcnt = 0] = '\0';
+	sp->len = 0;
+	sp->stuck = false;
+	return;
+}
+
+size_t
+spill_len(spill *sp)
+{
+	return sp->len;
+}
+
+const char *
+spill_view(spill *sp, size_t *len)
+{
+	*len = sp->len;
+	if (sp->fd == -1)
+		return sp->buf;
+
+	if (!flush(sp))
+		return NULL;
+
+	unmap(sp);
+	void *m = mmap(NULL, sp->len, PROT_READ, MAP_SHARED, sp->fd, 0);
+	if (m == MAP_FAILED)
+		return NULL;
+
+	sp->map = m;
+	sp->mapsz = sp->len;
+	return m;
+}
+
+int
+spill_fd(spill *sp)
+{
+	if (sp->fd == -1 || !flush(sp))
+		return -1;
+
+	return sp->fd;
+}
+
+
+
+/* move what we have to a file; false (and nothing changed) if we can't */
+static bool
+spillout(spill *sp)
+{
+	int fd = tmpfd();
+	if (fd == -1)
+		return false;
+
+	if (!xwrite_raw(fd, sp->buf, sp->bufcnt)) {
+		close(fd);
+		return false;
+	}
+
+	D("spilled %zu bytes to a file", sp->bufcnt);
+	sp->fd = fd;
+	sp->bufcnt = 0;
+	trimbuf(&sp->buf, &sp->bufsz, 0, STAGESZ, STAGESZ);
+	return true;
+}
+
+static bool
+flush(spill *sp)
+{
+	if (!xwrite_raw(sp->fd, sp->buf, sp->bufcnt))
+		return false;
+
+	sp->bufcnt = 0;
+	return true;
+}
+
+static void
+unmap(spill *sp)
+{
+	if (!sp->map)
+		return;
+
+	munmap(sp->map, sp->mapsz);
+	sp->map = NULL;
+	return;
+}
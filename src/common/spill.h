@@ -0,0 +1,39 @@
+/* spill.h - Append-only buffer that moves to a temporary file when big
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef COMMON_SPILL_H
+#define COMMON_SPILL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct spill spill;
+
+/* Once a spill holds more than `bytes`, what it has goes to an unlinked
+ * file in $TMPDIR and so does everything appended after that, so memory
+ * use stays put however much there is.  0: never.  Applies to spills
+ * created afterwards */
+void spill_threshold(size_t bytes);
+
+spill *spill_new(void);
+void spill_destroy(spill *sp);
+
+/* false if the file couldn't be written to (errno set); what was there
+ * before is still there then, `data` isn't */
+bool spill_append(spill *sp, const void *data, size_t len);
+
+/* forget everything, back to memory */
+void spill_reset(spill *sp);
+
+size_t spill_len(spill *sp);
+
+/* everything appended so far, valid until the next call on `sp`; for a
+ * spilled one that's a mapping of the file.  NULL on error (errno set) */
+const char *spill_view(spill *sp, size_t *len);
+
+/* the file everything appended so far is in, from offset 0 on; it's
+ * still `sp`'s.  -1 if it's not spilled, or on error (errno set) */
+int spill_fd(spill *sp);
+
+#endif
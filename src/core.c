@@ -11,64 +11,429 @@
 #include "core.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "cache.h"
 #include "common/common.h"
 #include "common/log.h"
+#include "fleet.h"
+#include "replay.h"
 #include "sc.h"
+#include "script.h"
 #include "spawn.h"
+#include "tbl.h"
 #include "front/uc.h"
 
+/* pause before reconnecting to a switch we lost, doubling every time
+ * we lose it again */
+#define RECONNECT_MS 1000
+#define RECONNECT_MAX_MS 30000
+
+static sc *startsc(const char *host, tbl *t);
+static bool reconnect(const char *host, unsigned *lost, unsigned max);
+static bool restore(sc *s, replay *r);
+static bool waitready(sc *s, bool *streamed);
+static size_t getcmd(char *dest, size_t destsz);
+static void putrow(void *ctx, const struct tblrow *row);
+static void puthost(const char *host, const char *site, const char *error,
+                    const char *data, size_t len, int fd);
+static char *readfile(const char *path, size_t *len);
+
 
 /* initialize subsystems, attach user front end and switch back end */
 void
 core_init(const char *frontend, const char *backend, char **envp)
 {
 	spawn_init(envp);
-	sc_init(backend);
+	cache_init();
+	if (sc_init(backend) != 0)
+		C("cannot use backend '%s'", backend);
 	uc_attach(frontend);
 	uc_init();
 	I("core initialized");
 	return;
 }
 
-/* main loop, `host` is the switch we're going to talk to.
- * does not return */
+/* main loop, `host` is the switch we're going to talk to.  returns when
+ * the user is done, or when we lost the switch more than `reconnects`
+ * times in a row.  After reconnecting, we go back to the configuration
+ * context we were in and repeat the command in flight if it's known to
+ * be harmless and none of its output has been passed on yet */
 int
-core_run(const char *host)
+core_run(const char *host, unsigned reconnects)
 {
 	char buf[512];
+	char cmd[sizeof buf]; /* the command whose reply we're waiting for */
+	size_t cmdlen = 0;
+
+	/* replies from the cache are parsed here, the others by sc */
+	tbl *t = uc_wantrows() ? tbl_new(putrow, NULL) : NULL;
 
-	if (sc_start(host) != 0)
-		C("could not start sc");
+	replay *r = replay_new();
+	char ps1[256]; /* the prompt `cmd` was sent at */
+	size_t ps1len = 0;
 
+	sc *s = NULL;
+	unsigned lost = 0; /* sessions lost in a row */
+	int ec = EXIT_SUCCESS;
 	for (;;) {
-		spawn_operate();
+		bool fresh = !s;
+		if (!s)
+			s = startsc(host, t);
+
+		bool streamed = false;
+		if (!s || !waitready(s, fresh ? NULL : &streamed)
+		    || (fresh && !restore(s, r))) {
+			if (s)
+				uc_puterr("lost connection to %s: %s", host,
+				          sc_error(s));
+			/* some of its output may have reached the user
+			 * already; repeating it would show that twice */
+			if (cmdlen && (streamed
+			    || !cache_idempotent(cmd, cmdlen))) {
+				uc_puterr("'%.*s' may not have completed",
+				          (int)cmdlen - 1, cmd);
+				cmdlen = 0;
+			}
+
+			sc_destroy(s);
+			s = NULL;
+			if (!reconnect(host, &lost, reconnects)) {
+				ec = EXIT_FAILURE;
+				break;
+			}
+			continue;
+		}
+
+		size_t len;
+		if (fresh && cmdlen) {
+			uc_puterr("repeating '%.*s'", (int)cmdlen - 1, cmd);
+			sc_write(s, cmd, cmdlen);
+			continue;
+		}
+
+		lost = 0;
+
+		/* after logging in, that's the reply to whatever restore()
+		 * had to say, which is none of the user's business */
+		const char *rep = sc_getreply(s, &len);
+		if (len && !fresh)
+			uc_putdata(rep, len);
+
+		if (sc_timedout(s))
+			uc_puterr("'%.*s' timed out, interrupted", (int)cmdlen - 1,
+			          cmd);
+		else if (!streamed)
+			cache_put(host, cmd, cmdlen, rep, len);
 
-		while (sc_busy())
-			if (!sc_operate())
-				selectfd(sc_getfd(), true);
+		const char *p = sc_getps1(s, &len);
+		if (cmdlen)
+			replay_note(r, cmd, cmdlen, ps1, ps1len, p, len);
+		ps1len = len < sizeof ps1 ? len : sizeof ps1 - 1;
+		memcpy(ps1, p, ps1len);
+		uc_putps1(p, len);
 
-		if (sc_offline())
-			C("sc offline");
+		/* answer what we can from the cache; the switch isn't
+		 * involved, so the prompt stays the same */
+		size_t n;
+		while ((n = getcmd(buf, sizeof buf))
+		    && (rep = cache_get(host, buf, n, &len))) {
+			if (t) {
+				tbl_begin(t, buf, n);
+				tbl_feed(t, rep, len);
+				tbl_end(t);
+			}
 
-		if (sc_hasreply()) {
-			const char *rep = sc_getreply();
-			uc_putdata(rep, strlen(rep));
+			uc_putdata(rep, len);
+			uc_putps1(ps1, ps1len);
 		}
 
-		const char *ps1 = sc_getps1();
-		uc_putdata(ps1, strlen(ps1));
+		if (!n)
+			break; /* the user is done */
+
+		memcpy(cmd, buf, cmdlen = n);
+		sc_write(s, buf, n);
+	}
+
+	sc_destroy(s);
+	tbl_destroy(t);
+	replay_destroy(r);
+	return ec;
+}
+
+/* log in to `host`, push the configuration lines in `file` keeping up to
+ * `window` of them in flight, then report and return an exit status */
+int
+core_push(const char *host, const char *file, size_t window)
+{
+	size_t len;
+	char *data = readfile(file, &len);
+
+	sc *s = startsc(host, NULL);
+	if (!s || !waitready(s, NULL)) {
+		if (s)
+			uc_puterr("lost connection to %s: %s", host,
+			          sc_error(s));
+		sc_destroy(s);
+		free(data);
+		return EXIT_FAILURE;
+	}
+
+	N("pushing '%s' (%zu bytes) to '%s', window %zu", file, len, host,
+	  window);
+	if (sc_push(s, data, len, window) != 0) {
+		const char *ps1 = sc_getps1(s, &len);
+		uc_puterr("don't know how to push at prompt '%.*s'", (int)len,
+		          ps1);
+		sc_destroy(s);
+		free(data);
+		return EXIT_FAILURE;
+	}
+
+	bool ok = waitready(s, NULL);
+	free(data);
+	if (!ok) {
+		uc_puterr("lost connection to %s while pushing: %s", host,
+		          sc_error(s));
+		sc_destroy(s);
+		return EXIT_FAILURE;
+	}
+
+	const char *rep = sc_getreply(s, &len);
+	uc_putdata(rep, len);
+	const char *ps1 = sc_getps1(s, &len);
+	uc_putps1(ps1, len);
+
+	int ec = sc_pushfailed(s) ? EXIT_FAILURE : EXIT_SUCCESS;
+	sc_destroy(s);
+	return ec;
+}
+
+/* run the commands in `cmdfile` (or the script in `scriptfile`, if
+ * that's not empty) on every switch in `inventory`, lines of "<host>
+ * [<site>]", with up to `maxjobs` sessions in parallel on `threads`
+ * threads and at most `maxpersite` per site.  Results are reported per
+ * switch, in the order they complete; returns an exit status */
+int
+core_fleet(const char *inventory, const char *cmdfile,
+           const char *scriptfile, size_t maxjobs, size_t maxpersite,
+           unsigned retries, size_t threads)
+{
+	fleet_init(maxjobs, maxpersite, retries, threads);
+
+	size_t len;
+	char *inv = readfile(inventory, &len);
+	size_t nhosts = 0;
+	for (char *ln = strtok(inv, "\n"); ln; ln = strtok(NULL, "\n")) {
+		char *hash = strchr(ln, '#');
+		if (hash)
+			*hash = '\0';
+
+		char host[256], site[64];
+		int n = sscanf(ln, "%255s %63s", host, site);
+		if (n < 1)
+			continue;
+
+		fleet_add(host, n == 2 ? site : NULL);
+		nhosts++;
+	}
+	free(inv);
+
+	if (!nhosts)
+		C("no switches in '%s'", inventory);
+
+	size_t nfailed;
+	if (*scriptfile) {
+		script *sp = script_load(scriptfile);
+		nfailed = fleet_runscript(sp, puthost);
+		script_destroy(sp);
+	} else {
+		char *cmds = readfile(cmdfile, &len);
+		nfailed = fleet_run(cmds, len, puthost);
+		free(cmds);
+	}
+
+	return nfailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
 
-		if (uc_hasdata(true) == -1)
-			C("uc shat itself");
 
-		ssize_t n = uc_getdata(buf, sizeof buf);
-		if (n < 0)
-			C("uc massively shat itself");
-		else if (n == 0)
-			C("bug: uc doesn't have data yet claims to do");
 
-		sc_write(buf, n);
+/* a session to `host`, NULL if we couldn't even connect.  if `t` isn't
+ * NULL, the session parses into rows as well */
+static sc *
+startsc(const char *host, tbl *t)
+{
+	sc *s = sc_new();
+	if (t)
+		sc_setrows(s, putrow, NULL);
+
+	if (sc_start(s, host) != 0) {
+		uc_puterr("could not connect to %s: %s", host, sc_error(s));
+		sc_destroy(s);
+		return NULL;
 	}
+
+	return s;
+}
+
+/* bring a new session `s` back to the configuration context we were in
+ * before we lost the last one.  if the switch won't have it, we stay
+ * where we ended up; false only if we lost it again */
+static bool
+restore(sc *s, replay *r)
+{
+	size_t len;
+	const char *cmd, *ctx;
+	for (size_t i = 0; (cmd = replay_cmd(r, i, &len, &ctx)); i++) {
+		D("restoring '%s' by '%.*s'", ctx, (int)len - 1, cmd);
+		sc_write(s, cmd, len);
+		if (!waitready(s, NULL))
+			return false;
+
+		const char *ps1 = sc_getps1(s, &len);
+		if (!replay_incontext(ctx, ps1, len)) {
+			uc_puterr("could not get back to '%s', at '%.*s'", ctx,
+			          (int)len, ps1);
+			replay_clear(r);
+			break;
+		}
+	}
+
+	return true;
+}
+
+/* we lost the session to `host`, for the `*lost`th time in a row; wait a
+ * bit before trying again, unless that's more than `max` times */
+static bool
+reconnect(const char *host, unsigned *lost, unsigned max)
+{
+	if ((*lost)++ >= max)
+		return false;
+
+	unsigned long ms = backoff_ms(*lost, RECONNECT_MS, RECONNECT_MAX_MS);
+	uc_puterr("reconnecting to %s in %lu ms (%u/%u)", host, ms, *lost,
+	          max);
+	msleep(ms);
+	return true;
+}
+
+/* let sc do its thing until it's ready for the next command; false if
+ * we lost the switch instead.  unless `streamed` is NULL, the output is
+ * passed on as it comes, and `*streamed` tells whether any was */
+static bool
+waitready(sc *s, bool *streamed)
+{
+	sc_setstreaming(s, streamed != NULL);
+	spawn_operate();
+
+	while (sc_busy(s)) {
+		/* pass on what's final already, if only so that it doesn't
+		 * pile up here; if the front end is slow to take it, so are
+		 * we, and so the switch is */
+		size_t len;
+		const char *out = sc_peekreply(s, &len);
+		if (len) {
+			uc_putdata(out, len);
+			sc_consume(s, len);
+			*streamed = true;
+		}
+
+		if (sc_operate(s))
+			continue;
+
+		/* if there's a deadline, sc_operate() has to see it pass */
+		unsigned long ms = sc_holdoff(s);
+		if (ms)
+			msleep(ms);
+		else
+			waitfd(sc_getfd(s), sc_timeout(s));
+	}
+
+	spawn_operate();
+	return !sc_offline(s);
+}
+
+/* block until the user front end hands us a command; 0 if there won't
+ * be any more */
+static size_t
+getcmd(char *dest, size_t destsz)
+{
+	ssize_t n;
+	do {
+		if (uc_hasdata(true) == -1) {
+			I("uc is done");
+			return 0;
+		}
+
+		/* 0 if what it had was no good (e.g. a line too long for
+		 * `dest`); it has told the user, and we wait for more */
+		if ((n = uc_getdata(dest, destsz)) < 0) {
+			W("uc went away");
+			return 0;
+		}
+	} while (!n);
+
+	if ((size_t)n > destsz)
+		C("bug: uc handed out %zd bytes for %zu", n, destsz);
+
+	return n;
+}
+
+static void
+putrow(void *ctx, const struct tblrow *row)
+{
+	(void)ctx;
+	if (!uc_putrow(row))
+		W("uc didn't take the row");
+	return;
+}
+
+/* "### <host> (<site>): ok", followed by what it said */
+static void
+puthost(const char *host, const char *site, const char *error,
+        const char *data, size_t len, int fd)
+{
+	char hdr[512];
+	int n = snprintf(hdr, sizeof hdr, "### %s%s%s%s: %s%s\n", host,
+	                 site ? " (" : "", site ? site : "", site ? ")" : "",
+	                 error ? "failed: " : "ok", error ? error : "");
+	if (n < 0)
+		n = 0;
+	else if ((size_t)n >= sizeof hdr)
+		hdr[(n = sizeof hdr - 1) - 1] = '\n';
+
+	uc_putdata(hdr, n);
+	if (len && fd != -1)
+		uc_putfile(fd, data, len);
+	else if (len)
+		uc_putdata(data, len);
+
+	/* nothing more is coming for this switch */
+	uc_putps1("", 0);
+	return;
+}
+
+static char *
+readfile(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+		CE("fopen '%s'", path);
+
+	size_t sz = 4096, cnt = 0;
+	char *buf = xmalloc(sz);
+	size_t n;
+	while ((n = fread(buf + cnt, 1, sz - cnt, f)) > 0) {
+		cnt += n;
+		if (cnt == sz)
+			buf = xrealloc(buf, sz *= 2);
+	}
+
+	if (ferror(f))
+		CE("fread '%s'", path);
+
+	fclose(f);
+	*len = cnt;
+	return buf;
 }
@@ -5,7 +5,13 @@
 #ifndef CORE_H
 #define CORE_H
 
+#include <stddef.h>
+
 void core_init(const char *frontend, const char *backend, char **envp);
-int core_run(const char *host);
+int core_run(const char *host, unsigned reconnects);
+int core_push(const char *host, const char *file, size_t window);
+int core_fleet(const char *inventory, const char *cmdfile,
+               const char *scriptfile, size_t maxjobs, size_t maxpersite,
+               unsigned retries, size_t threads);
 
 #endif
@@ -0,0 +1,620 @@
+/* fleet.c - Run commands on many switches at once; handled by core
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_FLEET
+
+#include "fleet.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "common/common.h"
+#include "common/log.h"
+#include "common/spill.h"
+#include "sc.h"
+#include "script.h"
+#include "spawn.h"
+
+#define QUEUED 0  /* not started yet, or waiting to be retried */
+#define RUNNING 1
+#define DONE 2
+
+#define NOSITE SIZE_MAX
+
+#define HOSTSZ 256
+#define SITESZ 64
+
+/* first retry after about this long, doubling with every further one */
+#define BACKOFF_MS 500
+#define BACKOFF_MAX_MS 30000
+
+
+/* Every switch gets its own session, up to s_maxjobs (and s_maxpersite
+ * per site) of them at a time.  A single poll() covers all sessions
+ * waiting for their switch; whenever it returns we let those that can
+ * make progress run until they have to wait again, and start new ones
+ * as old ones finish.  Retry timers and sessions' deadlines are handled
+ * through poll()'s timeout.
+ *
+ * With more than one thread, each is a worker doing the above for its
+ * own share of the sessions, at most s_maxjobs / s_nworkers of them.
+ * Switches not started yet (or to be retried) are up for grabs by any
+ * worker with room, so while one is busy chewing through a huge reply,
+ * the others take on the rest.  Jobs' states and the counters are under
+ * s_lock, which is only held to claim a job or let go of one; starting,
+ * running and tearing down sessions is up to the worker that claimed
+ * them, without it.  f_done calls are kept from overlapping by s_outlock
+ * alone.  A worker that makes room kicks the others through their pipes,
+ * in case they were waiting for that. */
+
+struct site {
+	char name[SITESZ];
+	size_t running;
+};
+
+struct worker {
+	pthread_t thread;
+	struct job **jobs; /* the sessions it runs */
+	size_t njobs, maxjobs;
+	bool freed;        /* one of them ended, maybe making room for others */
+	int kick[2];       /* pipe, written to to wake it up */
+};
+
+struct job {
+	char host[HOSTSZ];
+	size_t site; /* in s_sites, or NOSITE */
+	int state;
+	sc *sc;
+	bool waiting;        /* for sc's fd to become readable */
+	unsigned tries;
+	uint64_t notbefore;  /* don't (re)start before this */
+
+	spill *out;     /* what we're going to hand to f_done */
+	bool streaming; /* the command in flight's output is going there */
+
+	scriptrun *run; /* if we're running s_script rather than s_cmds */
+};
+
+static size_t s_maxjobs;
+static size_t s_maxpersite;
+static unsigned s_retries;
+
+static struct job *s_jobs;
+static size_t s_jobssz, s_njobs;
+
+static struct site *s_sites;
+static size_t s_sitessz, s_nsites;
+
+static size_t s_running;
+static size_t s_ndone;
+static size_t s_nfailed;
+static fleet_done_fn s_f_done;
+
+static struct worker *s_workers;
+static size_t s_nworkers;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t s_outlock = PTHREAD_MUTEX_INITIALIZER;
+
+/* the commands to run, each terminated by a newline, no blank lines */
+static char *s_cmds;
+static size_t s_cmdslen;
+
+/* or the script to run, NULL if none */
+static const script *s_script;
+
+
+static size_t findsite(const char *name);
+static void *work(void *arg);
+static int schedule(struct worker *w, uint64_t now);
+static void claim(struct worker *w, struct job *j);
+static bool start(struct worker *w, struct job *j);
+static bool step(struct worker *w, struct job *j);
+static bool collect(struct job *j);
+static void lost(struct worker *w, struct job *j, const char *why);
+static void finish(struct worker *w, struct job *j, const char *error);
+static void stop(struct worker *w, struct job *j);
+static void release(struct worker *w, struct job *j);
+static void kick(struct worker *w);
+static bool append(struct job *j, const struct sc_result *r);
+
+
+void
+fleet_init(size_t maxjobs, size_t maxpersite, unsigned retries,
+           size_t threads)
+{
+	s_maxjobs = maxjobs ? maxjobs : 1;
+	s_maxpersite = maxpersite;
+	s_retries = retries;
+	s_jobs = xmalloc((s_jobssz = 16) * sizeof *s_jobs);
+	s_sites = xmalloc((s_sitessz = 16) * sizeof *s_sites);
+
+	/* no point in workers that can't have a session */
+	s_nworkers = threads ? threads : 1;
+	if (s_nworkers > s_maxjobs)
+		s_nworkers = s_maxjobs;
+
+	s_workers = xmalloc(s_nworkers * sizeof *s_workers);
+	for (size_t i = 0; i < s_nworkers; i++) {
+		struct worker *w = &s_workers[i];
+		w->maxjobs = (s_maxjobs + s_nworkers - 1) / s_nworkers;
+		w->jobs = xmalloc(w->maxjobs * sizeof *w->jobs);
+		w->njobs = 0;
+		w->freed = false;
+		w->kick[0] = w->kick[1] = -1;
+		if (s_nworkers == 1)
+			continue;
+
+		if (pipe(w->kick) != 0)
+			CE("pipe");
+		for (size_t k = 0; k < 2; k++) {
+			setblocking(w->kick[k], false);
+			fcntl(w->kick[k], F_SETFD, FD_CLOEXEC);
+		}
+	}
+
+	I("fleet initialized (jobs: %zu, per site: %zu, retries: %u, "
+	  "threads: %zu)", s_maxjobs, s_maxpersite, s_retries, s_nworkers);
+	return;
+}
+
+void
+fleet_add(const char *host, const char *site)
+{
+	if (s_njobs == s_jobssz)
+		s_jobs = xrealloc(s_jobs, (s_jobssz *= 2) * sizeof *s_jobs);
+
+	struct job *j = &s_jobs[s_njobs++];
+	memset(j, 0, sizeof *j);
+	snprintf(j->host, sizeof j->host, "%s", host);
+	j->site = site && *site ? findsite(site) : NOSITE;
+	j->state = QUEUED;
+	j->out = spill_new();
+
+	D("added '%s' (site '%s')", j->host, site ? site : "");
+	return;
+}
+
+size_t
+fleet_run(const char *cmds, size_t len, fleet_done_fn f_done)
+{
+	/* make sure every command, including the last, ends in a newline
+	 * so we can queue them as they are */
+	s_cmds = xmalloc(len + 2);
+	s_cmdslen = 0;
+	for (const char *p = cmds, *end = cmds + len; p < end;) {
+		const char *nl = memchr(p, '\n', end - p);
+		size_t n = nl ? (size_t)(nl - p) : (size_t)(end - p);
+		if (strspn(p, " \t\r") < n) {
+			memcpy(s_cmds + s_cmdslen, p, n);
+			s_cmdslen += n;
+			s_cmds[s_cmdslen++] = '\n';
+		}
+		p += n + 1;
+	}
+	s_cmds[s_cmdslen] = '\0';
+
+	s_f_done = f_done;
+
+	N("running %s on %zu switches", s_script ? "script" : "commands",
+	  s_njobs);
+
+	/* the first worker is us */
+	for (size_t i = 1; i < s_nworkers; i++) {
+		int e = pthread_create(&s_workers[i].thread, NULL, work,
+		                       &s_workers[i]);
+		if (e) {
+			errno = e;
+			CE("pthread_create");
+		}
+	}
+
+	work(&s_workers[0]);
+
+	for (size_t i = 1; i < s_nworkers; i++)
+		pthread_join(s_workers[i].thread, NULL);
+
+	for (size_t i = 0; i < s_nworkers; i++) {
+		free(s_workers[i].jobs);
+		if (s_workers[i].kick[0] != -1) {
+			close(s_workers[i].kick[0]);
+			close(s_workers[i].kick[1]);
+		}
+	}
+	free(s_workers);
+
+	N("%zu/%zu switches done, %zu failed", s_ndone, s_njobs, s_nfailed);
+	free(s_cmds);
+	return s_nfailed;
+}
+
+size_t
+fleet_runscript(const script *sp, fleet_done_fn f_done)
+{
+	s_script = sp;
+	return fleet_run("", 0, f_done);
+}
+
+
+
+static size_t
+findsite(const char *name)
+{
+	for (size_t i = 0; i < s_nsites; i++)
+		if (strcmp(s_sites[i].name, name) == 0)
+			return i;
+
+	if (s_nsites == s_sitessz)
+		s_sites = xrealloc(s_sites, (s_sitessz *= 2) * sizeof *s_sites);
+
+	snprintf(s_sites[s_nsites].name, SITESZ, "%s", name);
+	s_sites[s_nsites].running = 0;
+	return s_nsites++;
+}
+
+/* a worker's event loop; returns once every switch is done */
+static void *
+work(void *arg)
+{
+	struct worker *w = arg;
+	struct pollfd *pfds = xmalloc((w->maxjobs + 1) * sizeof *pfds);
+	struct job **pjobs = xmalloc((w->maxjobs + 1) * sizeof *pjobs);
+
+	for (;;) {
+		spawn_operate();
+		w->freed = false;
+
+		pthread_mutex_lock(&s_lock);
+		bool over = s_ndone == s_njobs;
+		int timeout = over ? -1 : schedule(w, timestamp_ms());
+		pthread_mutex_unlock(&s_lock);
+		if (over)
+			break;
+
+		/* the first one is for being kicked, if we can be */
+		size_t npfds = 1;
+		pfds[0] = (struct pollfd){ .fd = w->kick[0], .events = POLLIN };
+		pjobs[0] = NULL;
+
+		/* start() and step() may end sessions, which takes them out
+		 * of w->jobs */
+		for (size_t i = 0; i < w->njobs; i++) {
+			struct job *j = w->jobs[i];
+			if ((!j->sc && !start(w, j))
+			    || (!j->waiting && !step(w, j))) {
+				i--;
+				continue;
+			}
+
+			/* step() only returns if it has to wait, for its fd
+			 * or for some time to pass */
+			unsigned long ms = sc_holdoff(j->sc);
+			if (ms && (timeout == -1 || ms < (unsigned)timeout))
+				timeout = (int)ms;
+
+			long dl = sc_timeout(j->sc);
+			if (dl >= 0 && (timeout == -1 || dl < timeout))
+				timeout = (int)dl;
+
+			pfds[npfds] = (struct pollfd){
+				.fd = ms ? -1 : sc_getfd(j->sc),
+				.events = POLLIN,
+			};
+			pjobs[npfds++] = j;
+		}
+
+		/* don't wait if there's room for others now */
+		if (w->freed)
+			timeout = 0;
+
+		if (npfds == 1 && timeout == -1 && w->kick[0] == -1) {
+			pthread_mutex_lock(&s_lock);
+			if (s_ndone != s_njobs)
+				C("bug: nothing to wait for (%zu/%zu done)",
+				  s_ndone, s_njobs);
+			pthread_mutex_unlock(&s_lock);
+			continue;
+		}
+
+		V("polling %zu sessions, timeout %d", npfds - 1, timeout);
+		int r = poll(pfds, npfds, timeout);
+		if (r == -1) {
+			if (errno == EINTR)
+				continue;
+			CE("poll");
+		}
+
+		if (pfds[0].revents) {
+			char buf[64];
+			while (read(w->kick[0], buf, sizeof buf) > 0)
+				;
+		}
+
+		for (size_t i = 1; i < npfds; i++)
+			if (pfds[i].revents
+			    || (pfds[i].fd == -1 && !sc_holdoff(pjobs[i]->sc))
+			    || sc_timeout(pjobs[i]->sc) == 0)
+				pjobs[i]->waiting = false;
+	}
+
+	free(pfds);
+	free(pjobs);
+	return NULL;
+}
+
+/* claim what we may start on `w`; returns how many ms until a retry
+ * timer expires, -1 if there are none or we're busy anyway.  Under
+ * s_lock */
+static int
+schedule(struct worker *w, uint64_t now)
+{
+	uint64_t next = UINT64_MAX;
+	for (size_t i = 0; i < s_njobs; i++) {
+		struct job *j = &s_jobs[i];
+		if (j->state != QUEUED)
+			continue;
+
+		if (j->notbefore > now) {
+			if (j->notbefore < next)
+				next = j->notbefore;
+			continue;
+		}
+
+		if (s_running == s_maxjobs || w->njobs == w->maxjobs)
+			return -1; /* back here as soon as one finishes */
+
+		if (s_maxpersite && j->site != NOSITE
+		    && s_sites[j->site].running == s_maxpersite)
+			continue; /* whenever one there finishes, we'll be back */
+
+		claim(w, j);
+	}
+
+	return next == UINT64_MAX ? -1 : (int)(next - now);
+}
+
+/* `j` is w's to start, see start().  Under s_lock */
+static void
+claim(struct worker *w, struct job *j)
+{
+	j->tries++;
+	j->state = RUNNING;
+	s_running++;
+	if (j->site != NOSITE)
+		s_sites[j->site].running++;
+	w->jobs[w->njobs++] = j;
+	return;
+}
+
+/* get a session going for the job we claimed; false if we couldn't,
+ * `j` isn't w's anymore then */
+static bool
+start(struct worker *w, struct job *j)
+{
+	D("starting '%s' (try %u)", j->host, j->tries);
+	j->waiting = false;
+	spill_reset(j->out);
+	j->streaming = false;
+
+	j->sc = sc_new();
+	if (sc_start(j->sc, j->host) != 0) {
+		lost(w, j, sc_error(j->sc));
+		return false;
+	}
+
+	/* sc sends them one after the other once we're logged in; their
+	 * output goes to j->out as it comes, see collect().  A script sends
+	 * its own whenever we're READY, see step() */
+	sc_setstreaming(j->sc, true);
+	if (s_script) {
+		scriptrun_destroy(j->run);
+		j->run = scriptrun_new(s_script);
+	} else if (s_cmdslen)
+		sc_queue(j->sc, s_cmds, s_cmdslen);
+	return true;
+}
+
+/* let the session run until it has to wait for its switch, or is over;
+ * false in the latter case, `j` isn't w's anymore then */
+static bool
+step(struct worker *w, struct job *j)
+{
+	for (;;) {
+		if (!collect(j)) {
+			char why[128];
+			snprintf(why, sizeof why, "could not keep output: %s",
+			         strerror(errno));
+			finish(w, j, why);
+			return false;
+		}
+
+		if (sc_ready(j->sc)) {
+			int sr = j->run ? scriptrun_resume(j->run, j->sc)
+			    : SCRIPT_DONE;
+			if (sr == SCRIPT_RUNNING)
+				continue;
+
+			finish(w, j, sr == SCRIPT_FAILED
+			    ? scriptrun_error(j->run) : NULL);
+			return false;
+		}
+
+		int r = sc_operate(j->sc);
+		if (r == -1) {
+			lost(w, j, sc_error(j->sc));
+			return false;
+		} else if (r == 0) {
+			j->waiting = true;
+			return true;
+		}
+	}
+}
+
+/* add whatever commands are done to the output, and what's final of
+ * the one in flight; false if we couldn't (errno set) */
+static bool
+collect(struct job *j)
+{
+	struct sc_result r;
+	while (sc_take(j->sc, &r)) {
+		if (!append(j, &r))
+			return false;
+		j->streaming = false;
+		if (j->run)
+			scriptrun_feed(j->run, r.reply, r.replylen);
+
+		if (r.timedout) {
+			W("'%s': '%.*s' timed out", j->host, (int)r.cmdlen - 1,
+			  r.cmd);
+			if (!spill_append(j->out, "% timed out, interrupted\n", 25))
+				return false;
+		}
+	}
+
+	size_t len;
+	const char *out = sc_peekreply(j->sc, &len);
+	if (!len || !sc_inflight(j->sc, &r))
+		return true;
+
+	r.reply = out;
+	r.replylen = len;
+	if (!append(j, &r))
+		return false;
+
+	j->streaming = true;
+	if (j->run)
+		scriptrun_feed(j->run, out, len);
+	sc_consume(j->sc, len);
+	return true;
+}
+
+/* the session could not be started or went away; try again later, if
+ * we still may */
+static void
+lost(struct worker *w, struct job *j, const char *why)
+{
+	if (j->tries > s_retries) {
+		finish(w, j, why);
+		return;
+	}
+
+	unsigned long backoff = backoff_ms(j->tries, BACKOFF_MS, BACKOFF_MAX_MS);
+	N("'%s': %s (try %u), retrying in %lu ms", j->host, why, j->tries,
+	  backoff);
+
+	stop(w, j);
+	pthread_mutex_lock(&s_lock);
+	j->state = QUEUED;
+	j->notbefore = timestamp_ms() + backoff;
+	release(w, j);
+	pthread_mutex_unlock(&s_lock);
+	return;
+}
+
+/* hand the job's output to f_done, and be done with it */
+static void
+finish(struct worker *w, struct job *j, const char *error)
+{
+	size_t len;
+	const char *out = spill_view(j->out, &len);
+	if (!out) {
+		WE("'%s': map output", j->host);
+		out = "";
+		len = 0;
+		if (!error)
+			error = "could not map output";
+	}
+
+	if (error)
+		W("'%s' failed: %s", j->host, error);
+	else
+		D("'%s' done", j->host);
+
+	int fd = spill_fd(j->out);
+	pthread_mutex_lock(&s_outlock);
+	s_f_done(j->host, j->site == NOSITE ? NULL : s_sites[j->site].name,
+	         error, out, len, fd);
+	pthread_mutex_unlock(&s_outlock);
+
+	/* `error` may be the script's or the session's */
+	bool failed = error;
+	stop(w, j);
+	spill_destroy(j->out);
+	j->out = NULL;
+	scriptrun_destroy(j->run);
+	j->run = NULL;
+
+	pthread_mutex_lock(&s_lock);
+	if (failed)
+		s_nfailed++;
+	j->state = DONE;
+	s_ndone++;
+	release(w, j); /* if that was the last, the others are done, too */
+	pthread_mutex_unlock(&s_lock);
+	return;
+}
+
+/* done with the session, for now; `w` lets go of it, see release() */
+static void
+stop(struct worker *w, struct job *j)
+{
+	sc_destroy(j->sc);
+	j->sc = NULL;
+	w->freed = true;
+
+	for (size_t i = 0; i < w->njobs; i++)
+		if (w->jobs[i] == j) {
+			w->jobs[i] = w->jobs[--w->njobs];
+			break;
+		}
+
+	return;
+}
+
+/* give back what claim() took, making room for others.  Under s_lock */
+static void
+release(struct worker *w, struct job *j)
+{
+	s_running--;
+	if (j->site != NOSITE)
+		s_sites[j->site].running--;
+
+	kick(w);
+	return;
+}
+
+/* wake the workers other than `w`, there may be something for them */
+static void
+kick(struct worker *w)
+{
+	for (size_t i = 0; i < s_nworkers; i++)
+		if (&s_workers[i] != w && s_workers[i].kick[1] != -1)
+			if (write(s_workers[i].kick[1], "", 1) == -1
+			    && errno != EAGAIN)
+				EE("write kick");
+	return;
+}
+
+/* `r`'s prompt and command, unless we did that when its output started
+ * coming, and its reply; false if that didn't work (errno set) */
+static bool
+append(struct job *j, const struct sc_result *r)
+{
+	if (!j->streaming && (!spill_append(j->out, r->ps1, r->ps1len)
+	    || !spill_append(j->out, r->cmd, r->cmdlen)))
+		return false;
+
+	return spill_append(j->out, r->reply, r->replylen);
+}
@@ -0,0 +1,41 @@
+/* fleet.h - Run commands on many switches at once; handled by core
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef FLEET_H
+#define FLEET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "script.h"
+
+/* A host is done; `data` is everything it said, `error` is NULL if it
+ * went fine and why it didn't otherwise.  If what it said was big enough
+ * to go to a file, `fd` is that file (from offset 0 on, ours, good only
+ * during the call), -1 otherwise */
+typedef void (*fleet_done_fn)(const char *host, const char *site,
+                              const char *error, const char *data,
+                              size_t len, int fd);
+
+/* At most `maxjobs` sessions at a time, at most `maxpersite` (0: no
+ * limit) of them with switches on the same site.  A session that could
+ * not be started or got lost is retried `retries` times, backing off.
+ * The sessions are run by `threads` threads */
+void fleet_init(size_t maxjobs, size_t maxpersite, unsigned retries,
+                size_t threads);
+
+/* add a switch; `site` may be NULL */
+void fleet_add(const char *host, const char *site);
+
+/* Run the newline-separated `cmds` on every switch added, handing each
+ * one's result to `f_done` in the order they complete (one at a time,
+ * but from any of the threads).  Returns the number of switches that
+ * failed */
+size_t fleet_run(const char *cmds, size_t len, fleet_done_fn f_done);
+
+/* Like fleet_run(), but run the script `sp` on every switch; one that
+ * fails it counts as failed, with the script's reason */
+size_t fleet_runscript(const script *sp, fleet_done_fn f_done);
+
+#endif
@@ -0,0 +1,392 @@
+/* uc_fr.c - Framed user interface for programs; handled by core (via uc)
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_FRONT_FR_UC_FR
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "../../common/log.h"
+#include "../../common/common.h"
+#include "../../tbl.h"
+#include "../uc.h"
+
+#define READBUFSZ 4095
+
+/* Input is like with uc_ia, one command per line on stdin.  Everything
+ * written to stdout comes in frames, a line "<type> <length>" followed by
+ * <length> bytes of payload and a newline.  Frame types are:
+ *   out  command output
+ *   ps1  the prompt; the reply to the command is complete
+ *   hdr  "<table>\t<column>\t<column>..." for the rows that follow
+ *   row  "<table>\t<value>\t<value>..." a row of parsed command output
+ *   err  something went wrong, e.g. we lost the switch
+ *   fd   like out, but the payload is in a file instead (see below)
+ * A reply is any number of out and fd frames, handed out as the output
+ * comes in, then its ps1 frame; their payloads put together are the
+ * output.  A row is sent as soon as its line of output is complete, so
+ * it precedes the out or fd frame holding that line; all of a reply's
+ * rows precede its ps1 frame.
+ *
+ * If stdout is a Unix domain socket and SWH_FR_FDMIN is set in the
+ * environment, output of at least that many bytes isn't copied through
+ * the socket.  Its file's descriptor is passed along with the frame
+ * (SCM_RIGHTS) instead, to be mmap()ed or read from offset 0.  Such a
+ * frame is "fd <length>" and an empty line, <length> being how much of
+ * the file is the payload.  Output that's in a file already (a fleet
+ * result that got big, see spill.h) is passed as that file; anything
+ * else is written to an unlinked temporary file first.  We don't keep
+ * the file open, the descriptor is all that's left of it */
+
+
+static char s_readbuf[READBUFSZ + 1];
+static size_t s_readbufcnt = 0;
+static bool s_eof; /* no more input after what's in s_readbuf */
+static bool s_skip; /* dropping the rest of a line that's too long */
+
+static char *s_rowbuf;
+static size_t s_rowbufsz;
+
+static size_t s_nframes;
+
+/* output at least this big goes out as an fd frame, 0: never */
+static size_t s_fdmin;
+
+
+static bool putframe(const char *type, const void *data, size_t datalen);
+static bool putfd(const void *data, size_t datalen);
+static bool sendfd(int fd, size_t datalen);
+static bool unixsock(int fd);
+static size_t join(const char *table, const char *const *fields, size_t n);
+static ssize_t read_more(void);
+
+
+void
+uc_fr_init(void)
+{
+	/* frames are flushed out along with the prompt */
+	if (setvbuf(stdout, NULL, _IOFBF, 64 * 1024) != 0)
+		WE("setvbuf");
+	(s_rowbuf = xmalloc(s_rowbufsz = 256))[0] = '\0';
+
+	const char *fdmin = getenv("SWH_FR_FDMIN");
+	if (fdmin && *fdmin) {
+		if (unixsock(1)) {
+			s_fdmin = strtoul(fdmin, NULL, 10);
+			I("passing output of %zu bytes and up by descriptor",
+			  s_fdmin);
+		} else
+			W("stdout isn't a unix socket, can't pass descriptors");
+	}
+
+	I("uc-fr initialized");
+	return;
+}
+
+int
+uc_fr_hasdata(bool block)
+{
+	if (strchr(s_readbuf, '\n'))
+		return 1;
+
+	if (s_eof)
+		return -1;
+
+	while (selectfd(0, block)) {
+		if (read_more() <= 0)
+			return strchr(s_readbuf, '\n') ? 1 : -1;
+		if (strchr(s_readbuf, '\n'))
+			return 1;
+	}
+
+	return 0;
+}
+
+ssize_t
+uc_fr_getdata(char *dest, size_t destsz)
+{
+	/* better not to send a truncated command at all */
+	char *p;
+	size_t len;
+	while ((p = strchr(s_readbuf, '\n'))
+	    && (len = p - s_readbuf + 1) > destsz) {
+		W("command too long (%zu bytes), dropping", len);
+		uc_puterr("command too long (%zu bytes, max %zu), ignored",
+		          len, destsz);
+		shiftbuf(s_readbuf, &s_readbufcnt, len);
+		s_readbuf[s_readbufcnt] = '\0';
+	}
+
+	if (!p)
+		return 0;
+
+	memcpy(dest, s_readbuf, len);
+	shiftbuf(s_readbuf, &s_readbufcnt, len);
+	s_readbuf[s_readbufcnt] = '\0';
+	return len;
+}
+
+bool
+uc_fr_putdata(const void *data, size_t datalen)
+{
+	if (s_fdmin && datalen >= s_fdmin)
+		return putfd(data, datalen);
+
+	return putframe("out", data, datalen);
+}
+
+/* `data` is in `fd` already, so there's nothing to copy */
+bool
+uc_fr_putfile(int fd, const void *data, size_t datalen)
+{
+	if (!s_fdmin || datalen < s_fdmin)
+		return putframe("out", data, datalen);
+
+	/* for those read()ing it */
+	if (lseek(fd, 0, SEEK_SET) == -1) {
+		WE("lseek");
+		return putfd(data, datalen);
+	}
+
+	return sendfd(fd, datalen);
+}
+
+bool
+uc_fr_putps1(const void *data, size_t datalen)
+{
+	if (!putframe("ps1", data, datalen))
+		return false;
+
+	if (fflush(stdout) != 0) {
+		WE("fflush");
+		return false;
+	}
+
+	return true;
+}
+
+bool
+uc_fr_putrow(const struct tblrow *row)
+{
+	size_t n;
+	if (row->first) {
+		n = join(row->table, row->names, row->ncols);
+		if (!putframe("hdr", s_rowbuf, n))
+			return false;
+	}
+
+	n = join(row->table, row->vals, row->ncols);
+	return putframe("row", s_rowbuf, n);
+}
+
+bool
+uc_fr_puterr(const void *data, size_t datalen)
+{
+	if (!putframe("err", data, datalen))
+		return false;
+
+	if (fflush(stdout) != 0) {
+		WE("fflush");
+		return false;
+	}
+
+	return true;
+}
+
+void
+uc_fr_dump(void)
+{
+	A("uc-fr dump");
+	A("s_readbufcnt: %zu", s_readbufcnt);
+	A("s_nframes: %zu", s_nframes);
+	A("s_fdmin: %zu", s_fdmin);
+	A("uc-fr end of dump");
+	return;
+}
+
+
+
+static bool
+putframe(const char *type, const void *data, size_t datalen)
+{
+	if (printf("%s %zu\n", type, datalen) < 0
+	    || fwrite(data, 1, datalen, stdout) != datalen
+	    || putchar('\n') == EOF) {
+		WE("writing %s frame", type);
+		return false;
+	}
+
+	s_nframes++;
+	return true;
+}
+
+/* an fd frame for `data`; if we can't make the file, it goes out as an
+ * out frame after all.  false if the client is gone */
+static bool
+putfd(const void *data, size_t datalen)
+{
+	int fd = tmpfd();
+	if (fd == -1 || !xwrite_raw(fd, data, datalen)
+	    || lseek(fd, 0, SEEK_SET) == -1) {
+		W("can't pass %zu bytes by descriptor, sending them", datalen);
+		if (fd != -1)
+			close(fd);
+		return putframe("out", data, datalen);
+	}
+
+	bool r = sendfd(fd, datalen);
+	close(fd);
+	return r;
+}
+
+/* an fd frame for the first `datalen` bytes of `fd`, which stays ours.
+ * false if the client is gone */
+static bool
+sendfd(int fd, size_t datalen)
+{
+	/* this frame bypasses stdio, whatever is buffered goes first */
+	if (fflush(stdout) != 0) {
+		WE("fflush");
+		return false;
+	}
+
+	char hdr[32];
+	size_t hdrlen = (size_t)snprintf(hdr, sizeof hdr, "fd %zu\n\n",
+	                                 datalen);
+	struct iovec iov = { .iov_base = hdr, .iov_len = hdrlen };
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof fd)];
+	} ctl;
+
+	struct msghdr msg;
+	memset(&msg, 0, sizeof msg);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = ctl.buf;
+	msg.msg_controllen = sizeof ctl.buf;
+
+	struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(sizeof fd);
+	memcpy(CMSG_DATA(cm), &fd, sizeof fd);
+
+	ssize_t r;
+	while ((r = sendmsg(1, &msg, 0)) == -1 && errno == EINTR)
+		;
+	if (r == -1) {
+		WE("sendmsg");
+		return false;
+	}
+
+	/* the descriptor went with the first byte, the rest is plain */
+	if ((size_t)r < hdrlen && !xwrite_raw(1, hdr + r, hdrlen - r))
+		return false;
+
+	D("passed %zu bytes by descriptor", datalen);
+	s_nframes++;
+	return true;
+}
+
+/* whether `fd` is a unix domain socket we can pass descriptors over */
+static bool
+unixsock(int fd)
+{
+	struct sockaddr_storage ss;
+	socklen_t len = sizeof ss;
+	if (getsockname(fd, (struct sockaddr *)&ss, &len) != 0)
+		return false;
+
+	return ss.ss_family == AF_UNIX;
+}
+
+/* "<table>\t<field>\t<field>..." into s_rowbuf, returns the length */
+static size_t
+join(const char *table, const char *const *fields, size_t n)
+{
+	size_t len = strlen(table);
+	growbuf(&s_rowbuf, &s_rowbufsz, len + 1);
+	memcpy(s_rowbuf, table, len);
+	for (size_t i = 0; i < n; i++) {
+		size_t l = strlen(fields[i]);
+		growbuf(&s_rowbuf, &s_rowbufsz, len + l + 2);
+		s_rowbuf[len++] = '\t';
+		memcpy(s_rowbuf + len, fields[i], l);
+		len += l;
+	}
+
+	return len;
+}
+
+static ssize_t
+read_more(void)
+{
+	size_t remain = READBUFSZ - s_readbufcnt;
+	if (!remain) {
+		W("no newline in %d bytes of input, dropping", READBUFSZ);
+		uc_puterr("command too long (over %d bytes), ignored",
+		          READBUFSZ);
+		s_readbufcnt = 0;
+		s_readbuf[0] = '\0';
+		s_skip = true;
+		remain = READBUFSZ;
+	}
+
+	ssize_t r = xread(0, s_readbuf + s_readbufcnt, remain);
+	if (r <= 0) {
+		if (r == -1)
+			WE("read");
+		else
+			I("EOF from user");
+
+		/* what's left is the last command, even without a newline */
+		s_eof = true;
+		if (s_readbufcnt && s_readbufcnt < READBUFSZ
+		    && s_readbuf[s_readbufcnt-1] != '\n') {
+			s_readbuf[s_readbufcnt++] = '\n';
+			s_readbuf[s_readbufcnt] = '\0';
+		}
+		return r;
+	}
+
+	D("read %zd bytes from user", r);
+	s_readbufcnt += (size_t)r;
+	s_readbuf[s_readbufcnt] = '\0';
+	if (s_skip) {
+		char *p = strchr(s_readbuf, '\n');
+		size_t n = p ? (size_t)(p - s_readbuf + 1) : s_readbufcnt;
+		shiftbuf(s_readbuf, &s_readbufcnt, n);
+		s_readbuf[s_readbufcnt] = '\0';
+		s_skip = !p;
+	}
+	return r;
+}
+
+
+void
+uc_fr_attach(struct uc_if *ifc)
+{
+	ifc->f_init = uc_fr_init;
+	ifc->f_hasdata = uc_fr_hasdata;
+	ifc->f_getdata = uc_fr_getdata;
+	ifc->f_putdata = uc_fr_putdata;
+	ifc->f_putps1 = uc_fr_putps1;
+	ifc->f_putfile = uc_fr_putfile;
+	ifc->f_putrow = uc_fr_putrow;
+	ifc->f_puterr = uc_fr_puterr;
+	ifc->f_dump = uc_fr_dump;
+	I("uc-fr attached");
+	return;
+}
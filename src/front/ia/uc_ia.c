@@ -22,6 +22,8 @@
 
 static char s_readbuf[READBUFSZ + 1];
 static size_t s_readbufcnt = 0;
+static bool s_eof; /* no more input after what's in s_readbuf */
+static bool s_skip; /* dropping the rest of a line that's too long */
 
 
 static ssize_t read_more(void);
@@ -45,10 +47,14 @@ uc_ia_hasdata(bool block)
 		return 1;
 	}
 
+	if (s_eof)
+		return -1;
+
 	V("can we maybe read some more?");
 	while (selectfd(0, block)) {
 		V("select(2) says we can read");
-		read_more();
+		if (read_more() <= 0)
+			return strchr(s_readbuf, '\n') ? 1 : -1;
 		if (strchr(s_readbuf, '\n')) {
 			V("now there's a whole line -> success");
 			return 1;
@@ -64,19 +70,25 @@ uc_ia_hasdata(bool block)
 ssize_t
 uc_ia_getdata(char *dest, size_t destsz)
 {
-	char *p = strchr(s_readbuf, '\n');
+	/* better not to send a truncated command at all */
+	char *p;
+	size_t len;
+	while ((p = strchr(s_readbuf, '\n'))
+	    && (len = p - s_readbuf + 1) > destsz) {
+		W("command too long (%zu bytes), dropping", len);
+		uc_puterr("command too long (%zu bytes, max %zu), ignored",
+		          len, destsz);
+		shiftbuf(s_readbuf, &s_readbufcnt, len);
+		s_readbuf[s_readbufcnt] = '\0';
+	}
+
 	if (!p) {
 		V("no data to hand out (rbc %zu)", s_readbufcnt);
 		return 0;
 	}
-	size_t len = p - s_readbuf + 1;
-	size_t copy = len;
-	if (copy >= destsz) {
-		W("data truncated, you're likely SOL"); // XXX
-		copy = destsz - 1;
-	}
-	D("handing out %zu/%zu bytes of data", copy, len);
-	memcpy(dest, s_readbuf, copy);
+
+	D("handing out %zu bytes of data", len);
+	memcpy(dest, s_readbuf, len);
 	shiftbuf(s_readbuf, &s_readbufcnt, len);
 	s_readbuf[s_readbufcnt] = '\0';
 	return len;
@@ -85,9 +97,13 @@ uc_ia_getdata(char *dest, size_t destsz)
 bool
 uc_ia_putdata(const void *data, size_t datalen)
 {
-	D("received %zu bytes of data, printing to stdout", datalen);
-	printf("%.*s", (int)datalen, (const char *)data);
-	fflush(stdout);
+	D("received %zu bytes of data, writing to stdout", datalen);
+	/* stdout is unbuffered, so this goes straight from the caller's
+	 * buffer to write(2) -- no formatting, no NUL scan, no copy */
+	if (fwrite(data, 1, datalen, stdout) != datalen) {
+		WE("fwrite");
+		return false;
+	}
 	return true;
 }
 
@@ -106,17 +122,44 @@ static ssize_t
 read_more(void)
 {
 	size_t remain = READBUFSZ - s_readbufcnt;
+	if (!remain) {
+		W("no newline in %d bytes of input, dropping", READBUFSZ);
+		uc_puterr("command too long (over %d bytes), ignored",
+		          READBUFSZ);
+		s_readbufcnt = 0;
+		s_readbuf[0] = '\0';
+		s_skip = true;
+		remain = READBUFSZ;
+	}
+
 	V("read(2)ing up to %zu bytes, blockingly", remain);
 	ssize_t r = xread(0, s_readbuf + s_readbufcnt, remain);
-	if (r == -1)
-		CE("read");
-	if (r == 0) {
-		C("read: EOF"); // XXX
+	if (r <= 0) {
+		if (r == -1)
+			WE("read");
+		else
+			I("EOF from user");
+
+		/* what's left is the last line, even without a newline */
+		s_eof = true;
+		if (s_readbufcnt && s_readbufcnt < READBUFSZ
+		    && s_readbuf[s_readbufcnt-1] != '\n') {
+			s_readbuf[s_readbufcnt++] = '\n';
+			s_readbuf[s_readbufcnt] = '\0';
+		}
+		return r;
 	}
 
 	D("read %zd bytes from user", r);
 	s_readbufcnt += (size_t)r;
 	s_readbuf[s_readbufcnt] = '\0';
+	if (s_skip) {
+		char *p = strchr(s_readbuf, '\n');
+		size_t n = p ? (size_t)(p - s_readbuf + 1) : s_readbufcnt;
+		shiftbuf(s_readbuf, &s_readbufcnt, n);
+		s_readbuf[s_readbufcnt] = '\0';
+		s_skip = !p;
+	}
 	hexdump(s_readbuf, s_readbufcnt, "readbuf");
 	return r;
 }
@@ -77,6 +77,11 @@ uc_noop_attach(struct uc_if *ifc)
 	ifc->f_getdata = uc_noop_getdata;
 	ifc->f_putdata = uc_noop_putdata;
 	ifc->f_dump = uc_noop_dump;
+	/* f_putps1, f_putfile, f_putrow and f_puterr are optional -- set
+	 * them if the frontend wants to tell the prompt apart from the
+	 * output, can pass on output that's in a file as the file, wants
+	 * the output of known commands parsed into rows (see tbl.h), or
+	 * wants error reports kept apart from the output */
 	I("uc-noop attached");
 	return;
 }
@@ -10,6 +10,7 @@
 
 #include "uc.h"
 
+#include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -65,6 +66,57 @@ uc_putdata(const void *data, size_t datalen)
 	return s_uc.f_putdata(data, datalen);
 }
 
+bool
+uc_putps1(const void *data, size_t datalen)
+{
+	if (!s_uc.f_putps1)
+		return s_uc.f_putdata(data, datalen);
+	return s_uc.f_putps1(data, datalen);
+}
+
+bool
+uc_putfile(int fd, const void *data, size_t datalen)
+{
+	if (!s_uc.f_putfile)
+		return s_uc.f_putdata(data, datalen);
+	return s_uc.f_putfile(fd, data, datalen);
+}
+
+bool
+uc_wantrows(void)
+{
+	return s_uc.f_putrow;
+}
+
+bool
+uc_putrow(const struct tblrow *row)
+{
+	if (!s_uc.f_putrow)
+		return true;
+	return s_uc.f_putrow(row);
+}
+
+bool
+uc_puterr(const char *fmt, ...)
+{
+	char msg[1024];
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(msg, sizeof msg - 1, fmt, ap);
+	va_end(ap);
+
+	if (n < 0)
+		n = 0;
+	else if ((size_t)n >= sizeof msg - 1)
+		n = sizeof msg - 2;
+
+	if (s_uc.f_puterr)
+		return s_uc.f_puterr(msg, n);
+
+	msg[n++] = '\n';
+	return s_uc.f_putdata(msg, n);
+}
+
 void
 uc_dump(void)
 {
@@ -11,12 +11,20 @@
 
 #include <sys/types.h>
 
-/* The uc interface and call dispatch struct */
+struct tblrow;
+
+/* The uc interface and call dispatch struct.  f_putps1, f_putfile,
+ * f_putrow and f_puterr are optional; front ends that don't care leave
+ * them NULL */
 struct uc_if {
 	void    (*f_init)(void);
 	int     (*f_hasdata)(bool block);
 	ssize_t (*f_getdata)(char *dest, size_t destsz);
 	bool    (*f_putdata)(const void *data, size_t datalen);
+	bool    (*f_putps1)(const void *data, size_t datalen);
+	bool    (*f_putfile)(int fd, const void *data, size_t datalen);
+	bool    (*f_putrow)(const struct tblrow *row);
+	bool    (*f_puterr)(const void *data, size_t datalen);
 	void    (*f_dump)(void);
 };
 
@@ -27,12 +35,31 @@ void uc_init(void);
 /* 0: no, 1: yes, -1: offline */
 int uc_hasdata(bool block);
 
-/* 0: no data, >0: data length, -1: offline */
+/* 0: no data (left; lines too long for `dest` are dropped, after
+ * telling the user), >0: data length, -1: offline */
 ssize_t uc_getdata(char *dest, size_t destsz);
 
 /* true: ok, false: offline */
 bool uc_putdata(const void *data, size_t datalen);
 
+/* Like uc_putdata, but it's the prompt, i.e. the reply is complete */
+bool uc_putps1(const void *data, size_t datalen);
+
+/* Like uc_putdata, but `data` is also in the file `fd` (from offset 0
+ * on), which the front end may pass on instead of the bytes.  `fd` stays
+ * the caller's */
+bool uc_putfile(int fd, const void *data, size_t datalen);
+
+/* Does the uc want command output parsed into rows? */
+bool uc_wantrows(void);
+
+/* true: ok, false: offline */
+bool uc_putrow(const struct tblrow *row);
+
+/* Tell the user something went wrong, e.g. we lost the switch; printf-like,
+ * without the newline.  true: ok, false: offline */
+bool uc_puterr(const char *fmt, ...);
+
 /* Dump state for debugging */
 void uc_dump(void);
 
@@ -17,24 +17,70 @@
 
 #include "common/log.h"
 #include "common/common.h"
+#include "common/spill.h"
 #include "nami.h"
+#include "cache.h"
 #include "core.h"
+#include "sc.h"
+#include "spawn.h"
+#include "xport/xport.h"
 
 
 /* selected user front-end (currently there's only one) */
 static char s_ux[32] = "auto";
 
-/* selected switch back-end (currently there's only one) */
+/* selected switch back-end; "auto" lets sc tell by the banner */
 static char s_sx[32] = "auto";
 
+/* definition for the "def" backend, if any */
+static char s_backdef[256];
+
 /* host to connect to */
 static char s_host[256];
 
+/* how to reach switches, see xport/transports.h, and whether to read
+ * from them on threads of their own */
+static char s_xport[32] = "ssh";
+static bool s_pipeline;
+
+/* whether to share one ssh connection per switch between sessions, and
+ * for how long to keep an unused one around, in secs */
+static bool s_mux;
+static unsigned long s_muxpersist;
+
+/* how often to reconnect if we lose it, in a row */
+static unsigned s_reconnects = 0;
+
+/* how long a switch has to log us in, and to answer a command, in secs
+ * (0: forever) */
+static unsigned long s_logintmo = 30;
+static unsigned long s_cmdtmo = 0;
+
+/* configuration to push instead of going interactive, and how many lines
+ * may be in flight */
+static char s_pushfile[256];
+static size_t s_pushwindow = 16;
+
+/* switches to run the commands in s_cmdfile on instead of going
+ * interactive, how many at a time (per site), how often to retry */
+static char s_inventory[256];
+static char s_cmdfile[256];
+static char s_scriptfile[256];
+static size_t s_jobs = 8;
+static size_t s_sitejobs = 0;
+static unsigned s_retries = 2;
+static size_t s_threads = 1;
+
+/* a switch's results beyond this many MiB go to a temporary file
+ * rather than staying in memory (0: never) */
+static size_t s_spillmb = 16;
+
 
 static void process_args(int argc, char **argv);
 static void init(int argc, char **argv, char **envp);
 static void usage(FILE *str, const char *a0, int ec);
 static void update_logger(int verb, int fancy);
+static void add_cacherule(const char *arg);
 
 
 static void
@@ -42,7 +88,8 @@ process_args(int argc, char **argv)
 {
 	char *a0 = argv[0];
 
-	for(int ch; (ch = getopt(argc, argv, "Xx:Ss:cvqh")) != -1;) {
+	for(int ch; (ch = getopt(argc, argv,
+	    "Xx:Ss:B:C:PM:T:R:t:l:p:w:f:e:E:j:J:N:r:O:cvqh")) != -1;) {
 		switch (ch) {
 		case 's':
 			snprintf(s_sx, sizeof s_sx, "%s", optarg);
@@ -50,12 +97,73 @@ process_args(int argc, char **argv)
 		case 'S':
 			nami_backends(stdout);
 			exit(0);
+		case 'B':
+			snprintf(s_backdef, sizeof s_backdef, "%s", optarg);
+			break;
 		case 'x':
 			snprintf(s_ux, sizeof s_ux, "%s", optarg);
 			break;
 		case 'X':
 			nami_frontends(stdout);
 			exit(0);
+		case 'C':
+			snprintf(s_xport, sizeof s_xport, "%s", optarg);
+			break;
+		case 'P':
+			s_pipeline = true;
+			break;
+		case 'M':
+			s_mux = true;
+			s_muxpersist = strtoul(optarg, NULL, 10);
+			break;
+		case 'T':
+			add_cacherule(optarg);
+			break;
+		case 'R':
+			s_reconnects = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			s_cmdtmo = strtoul(optarg, NULL, 10);
+			break;
+		case 'l':
+			s_logintmo = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			snprintf(s_pushfile, sizeof s_pushfile, "%s", optarg);
+			break;
+		case 'w':
+			s_pushwindow = strtoul(optarg, NULL, 10);
+			if (!s_pushwindow)
+				C("bad window size '%s'", optarg);
+			break;
+		case 'f':
+			snprintf(s_inventory, sizeof s_inventory, "%s", optarg);
+			break;
+		case 'e':
+			snprintf(s_cmdfile, sizeof s_cmdfile, "%s", optarg);
+			break;
+		case 'E':
+			snprintf(s_scriptfile, sizeof s_scriptfile, "%s", optarg);
+			break;
+		case 'j':
+			s_jobs = strtoul(optarg, NULL, 10);
+			if (!s_jobs)
+				C("bad number of jobs '%s'", optarg);
+			break;
+		case 'J':
+			s_sitejobs = strtoul(optarg, NULL, 10);
+			break;
+		case 'N':
+			s_threads = strtoul(optarg, NULL, 10);
+			if (!s_threads)
+				C("bad number of threads '%s'", optarg);
+			break;
+		case 'r':
+			s_retries = strtoul(optarg, NULL, 10);
+			break;
+		case 'O':
+			s_spillmb = strtoul(optarg, NULL, 10);
+			break;
 		case 'c':
 			update_logger(0, 1);
 			break;
@@ -77,16 +185,23 @@ process_args(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 
-	if (argc == 0)
+	if (s_inventory[0] || s_cmdfile[0] || s_scriptfile[0]) {
+		if (!s_inventory[0] || !s_cmdfile[0] == !s_scriptfile[0])
+			C("-f goes with either -e or -E");
+		if (argc)
+			C("no host argument with -f");
+	} else if (argc == 0)
 		C("argument missing (switch hostname or address)");
+	else
+		snprintf(s_host, sizeof s_host, "%s", argv[0]);
 
-	snprintf(s_host, sizeof s_host, "%s", argv[0]);
+	if (s_mux && strcmp(s_xport, "ssh") != 0)
+		C("-M only works with the ssh transport");
+	if (s_pipeline && strcmp(s_xport, "ssh") != 0)
+		C("-P only works with the ssh transport");
 
 	if (strcmp(s_ux, "auto") == 0)
 		strcpy(s_ux, "ia"); // There's just one uc for now
-
-	if (strcmp(s_sx, "auto") == 0)
-		strcpy(s_sx, "hp"); // There's just one backend for now
 }
 
 static void
@@ -97,7 +212,15 @@ init(int argc, char **argv, char **envp)
 
 	process_args(argc, argv);
 
+	if (s_backdef[0] && sc_loaddef(s_backdef) != 0)
+		C("bad backend definition '%s'", s_backdef);
 	core_init(s_ux, s_sx, envp);
+	xport_attach(s_xport);
+	xport_pipeline(s_pipeline);
+	sc_deadlines(s_logintmo * 1000, s_cmdtmo * 1000);
+	spill_threshold(s_spillmb * 1024 * 1024);
+	if (s_mux)
+		spawn_multiplex(s_muxpersist);
 
 	N("all subsystems initialized");
 }
@@ -109,12 +232,64 @@ usage(FILE *str, const char *a0, int ec)
 	U("================");
 	U("== "PACKAGE_NAME" v"PACKAGE_VERSION" ==");
 	U("================");
-	fprintf(str, "usage: %s [-x <frontend>] [-s <backend>] [-XScvqh]\n", a0);
+	fprintf(str, "usage: %s [-x <frontend>] [-s <backend>] [-B <file>]\n"
+	    "\t[-C <transport>] [-P] [-M <secs>] [-T <cmd>=<secs>] [-R <n>]\n"
+	    "\t[-t <secs>] [-l <secs>] [-p <file> [-w <window>]] [-XScvqh]\n"
+	    "\t<host>\n"
+	    "       %s [options] -f <inventory> {-e <cmdfile> | -E <script>}\n"
+	    "\t[-j <jobs>] [-J <jobs>] [-N <threads>] [-r <retries>] [-O <MiB>]\n",
+	    a0, a0);
 	U("");
 	U("\t-x <frontend>: Use user interface <frontend> (default: auto)");
 	U("\t-X: List known user interfaces types and exit");
-	U("\t-s <backend>: Use switch interface <backend> (default: auto)");
+	U("\t-s <backend>: Use switch interface <backend> (default: auto,");
+	U("\t    i.e. tell by what the switch says when we log in)");
 	U("\t-S: List known switch interfaces types and exit");
+	U("\t-B <file>: Load the description of a switch for the \"def\"");
+	U("\t    switch interface from <file> (see src/back/def/hp.def)");
+	U("\t-C <transport>: Reach switches through <transport>: ssh");
+	U("\t    (default, runs /usr/bin/ssh) or libssh (in-process, if");
+	U("\t    built with it; needs the host key known and key auth)");
+	U("\t-P: Read from each switch on a thread of its own, so that");
+	U("\t    it keeps coming while we're busy with a big reply");
+	U("\t-M <secs>: Keep one ssh connection per switch and open");
+	U("\t    sessions over it (ssh's ControlMaster), making reconnects");
+	U("\t    and retries cheap.  It's closed <secs> after its last");
+	U("\t    session ends (0: when we exit)");
+	U("\t-T <cmd>=<secs>: Cache replies to commands starting with <cmd>");
+	U("\t    for <secs> seconds (0: don't, but it doesn't change state).");
+	U("\t    Other commands invalidate the cache.  Multiple are OK,");
+	U("\t    the longest matching <cmd> wins.  E.g. -T show=30");
+	U("\t-R <n>: If we lose the switch, reconnect up to <n> times in a");
+	U("\t    row (default: 0), backing off.  The configuration context");
+	U("\t    is restored, and the command in flight repeated if it is");
+	U("\t    harmless, i.e. matches a -T rule.");
+	U("\t-t <secs>: Interrupt commands the switch takes longer than");
+	U("\t    <secs> to answer (default: 0, never).  When pushing, it's");
+	U("\t    how long the switch may go without making progress.");
+	U("\t-l <secs>: Give up on switches that take longer than <secs>");
+	U("\t    to log us in (default: 30, 0: never)");
+	U("\t-p <file>: Push the configuration lines in <file>, then exit.");
+	U("\t    Stops at the first line the switch rejects.");
+	U("\t-w <window>: Lines to send ahead of the switch's prompts when");
+	U("\t    pushing (default: 16)");
+	U("\t-f <inventory>: Run the commands in the -e <cmdfile> on every");
+	U("\t    switch listed in <inventory> (lines of \"<host> [<site>]\")");
+	U("\t    rather than going interactive.  Results are printed per");
+	U("\t    switch as they complete.");
+	U("\t-E <script>: ... or run <script> on each, answering questions");
+	U("\t    and checking output as it says (see src/script.h)");
+	U("\t-j <jobs>: Talk to up to <jobs> switches at once (default: 8)");
+	U("\t-J <jobs>: ... but to no more than <jobs> on the same site");
+	U("\t    (default: 0, no limit)");
+	U("\t-N <threads>: Spread the sessions over <threads> threads");
+	U("\t    (default: 1), so that a switch with a lot to say doesn't");
+	U("\t    hold up the others");
+	U("\t-r <retries>: Retry switches we couldn't reach or lost this");
+	U("\t    often, backing off (default: 2)");
+	U("\t-O <MiB>: Keep a switch's results in a temporary file rather");
+	U("\t    than in memory once they're over <MiB> (default: 16,");
+	U("\t    0: never)");
 	U("\t-c: Use ANSI color sequences on stderr");
 	U("\t-v: Be more verbose (multiple are OK)");
 	U("\t-q: Be less verbose (multiple are OK)");
@@ -140,11 +315,36 @@ update_logger(int verb, int fancy)
 	log_setlvl_all(v);
 }
 
+/* arg: "<cmd>=<secs>" */
+static void
+add_cacherule(const char *arg)
+{
+	const char *eq = strrchr(arg, '=');
+	if (!eq || eq == arg || !eq[1])
+		C("bad cache rule '%s' (expected <cmd>=<secs>)", arg);
+
+	char *end;
+	unsigned long ttl = strtoul(eq + 1, &end, 10);
+	if (*end)
+		C("bad cache rule '%s' (expected <cmd>=<secs>)", arg);
+
+	char cmd[512];
+	snprintf(cmd, sizeof cmd, "%.*s", (int)(eq - arg), arg);
+	cache_rule(cmd, ttl);
+}
+
 
 int
 main(int argc, char **argv, char **envp)
 {
 	init(argc, argv, envp);
 
-	return core_run(s_host);
+	if (s_inventory[0])
+		return core_fleet(s_inventory, s_cmdfile, s_scriptfile, s_jobs,
+		                  s_sitejobs, s_retries, s_threads);
+
+	if (s_pushfile[0])
+		return core_push(s_host, s_pushfile, s_pushwindow);
+
+	return core_run(s_host, s_reconnects);
 }
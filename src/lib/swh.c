@@ -0,0 +1,217 @@
+/* swh.c - libswh, switch sessions for programs to embed
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_LIB_SWH
+
+#include "swh.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/common.h"
+#include "../common/log.h"
+#include "../sc.h"
+#include "../spawn.h"
+#include "../xport/xport.h"
+
+extern char **environ;
+
+
+/* A session is an sc with the commands queued, streaming its output to
+ * f_output as it comes (see collect()) */
+struct swh {
+	sc *sc;
+	swh_output_fn f_output;
+	swh_done_fn f_done;
+	void *ctx;
+	bool kicked; /* there's work not waiting for the switch */
+};
+
+static const char *const s_backends[] = {
+#define X(IFNAME) #IFNAME,
+#include "../back/backends.h"
+#undef X
+};
+
+static const char *const s_transports[] = {
+#define X(IFNAME) #IFNAME,
+#include "../xport/transports.h"
+#undef X
+};
+
+
+static void collect(swh *h);
+static bool known(const char *name, const char *const *names, size_t n);
+
+
+int
+swh_init(const struct swh_config *cfg)
+{
+	log_init();
+
+	const char *backend = cfg->backend ? cfg->backend : "auto";
+	const char *transport = cfg->transport ? cfg->transport : "ssh";
+	if (strcmp(backend, "auto") != 0
+	    && !known(backend, s_backends, COUNTOF(s_backends))) {
+		E("no such backend: '%s'", backend);
+		return -1;
+	}
+
+	if (!known(transport, s_transports, COUNTOF(s_transports))) {
+		E("no such transport: '%s'", transport);
+		return -1;
+	}
+
+	spawn_init(environ);
+	if (cfg->backdef && sc_loaddef(cfg->backdef) != 0)
+		return -1;
+	if (sc_init(backend) != 0)
+		return -1;
+	xport_attach(transport);
+	xport_pipeline(cfg->pipelined);
+	sc_deadlines(cfg->login_ms, cfg->cmd_ms);
+	I("libswh initialized");
+	return 0;
+}
+
+swh *
+swh_open(const char *host, swh_output_fn f_output, swh_done_fn f_done,
+         void *ctx)
+{
+	swh *h = xmalloc(sizeof *h);
+	h->f_output = f_output;
+	h->f_done = f_done;
+	h->ctx = ctx;
+	h->kicked = true;
+
+	h->sc = sc_new();
+	sc_setstreaming(h->sc, true);
+	if (sc_start(h->sc, host) != 0)
+		W("could not start session to '%s': %s", host,
+		  sc_error(h->sc));
+
+	return h;
+}
+
+void
+swh_close(swh *h)
+{
+	if (!h)
+		return;
+
+	sc_destroy(h->sc);
+	free(h);
+	spawn_operate();
+	return;
+}
+
+int
+swh_submit(swh *h, const char *cmds, size_t len)
+{
+	if (sc_offline(h->sc))
+		return -1;
+
+	if (!len || cmds[len-1] != '\n') {
+		W("commands don't end in a newline, ignoring them");
+		return 0;
+	}
+
+	sc_queue(h->sc, cmds, len);
+	h->kicked = true;
+	return 0;
+}
+
+size_t
+swh_pending(swh *h)
+{
+	return sc_pending(h->sc);
+}
+
+int
+swh_fd(swh *h)
+{
+	return sc_getfd(h->sc);
+}
+
+long
+swh_timeout(swh *h)
+{
+	if (h->kicked)
+		return 0;
+
+	unsigned long ms = sc_holdoff(h->sc);
+	if (ms)
+		return (long)ms;
+
+	return sc_timeout(h->sc);
+}
+
+int
+swh_operate(swh *h)
+{
+	spawn_operate();
+	h->kicked = false;
+
+	for (;;) {
+		collect(h);
+		if (sc_offline(h->sc))
+			return -1;
+		if (sc_ready(h->sc))
+			return 1;
+
+		int r = sc_operate(h->sc);
+		if (r == -1) {
+			collect(h);
+			return -1;
+		} else if (r == 0)
+			return 0;
+	}
+}
+
+const char *
+swh_error(swh *h)
+{
+	return sc_error(h->sc);
+}
+
+
+
+/* hand out the output of the command in flight as far as it's final,
+ * and the rest of it along with the completion for those done */
+static void
+collect(swh *h)
+{
+	size_t len;
+	const char *out = sc_peekreply(h->sc, &len);
+	if (len) {
+		if (h->f_output)
+			h->f_output(h, h->ctx, out, len);
+		sc_consume(h->sc, len);
+	}
+
+	struct sc_result r;
+	while (sc_take(h->sc, &r)) {
+		if (r.replylen && h->f_output)
+			h->f_output(h, h->ctx, r.reply, r.replylen);
+		if (h->f_done)
+			h->f_done(h, h->ctx, r.cmd, r.cmdlen, r.ps1, r.ps1len,
+			          r.timedout);
+	}
+
+	return;
+}
+
+static bool
+known(const char *name, const char *const *names, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		if (strcmp(names[i], name) == 0)
+			return true;
+
+	return false;
+}
@@ -0,0 +1,84 @@
+/* swh.h - libswh, switch sessions for programs to embed
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef LIB_SWH_H
+#define LIB_SWH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* What the swh binary does for one switch, minus the front end, for
+ * any number of switches at once inside the caller's own event loop.
+ * Nothing blocks but logging in with the ssh transport's fork/exec.
+ *
+ * Per session, poll() swh_fd() for reading, with swh_timeout() as the
+ * timeout, and call swh_operate() when either goes off.  It does what it
+ * can without waiting and reports through the session's callbacks:
+ * output as it comes, then the command's completion.  Commands are
+ * queued with swh_submit() and run one after the other.
+ *
+ * Sessions are independent of each other; different threads may operate
+ * different ones, but each one is the business of one thread at a time.
+ * We install handlers for SIGCHLD (to reap ssh) and ignore SIGPIPE.
+ * What's left of exit()ing on errors is for running out of memory and
+ * for bugs */
+
+typedef struct swh swh;
+
+struct swh_config {
+	const char *backend;   /* "auto" (tell by the banner), "hp", "def" */
+	const char *backdef;   /* definition for "def", NULL if none */
+	const char *transport; /* "ssh" (default if NULL) or "libssh" */
+	bool pipelined;        /* ssh only: read on a thread per session */
+	unsigned long login_ms, cmd_ms; /* deadlines, 0: none */
+};
+
+/* Output of the command `h` is running, in order; `data` is valid
+ * during the call only */
+typedef void (*swh_output_fn)(swh *h, void *ctx, const char *data,
+                              size_t len);
+
+/* The command `cmd`, sent at prompt `ps1`, is done.  If it ran out of
+ * time, it was interrupted, so its output is incomplete.  Submitting
+ * more commands from here is fine */
+typedef void (*swh_done_fn)(swh *h, void *ctx, const char *cmd,
+                            size_t cmdlen, const char *ps1, size_t ps1len,
+                            bool timedout);
+
+/* Once, before anything else; -1 if `cfg` names something we don't know,
+ * or "def" without a usable `backdef` (the reason is logged), 0
+ * otherwise */
+int swh_init(const struct swh_config *cfg);
+
+/* Start logging in to `host` ([user@]host, as for ssh).  Never NULL; if
+ * we couldn't even get started, swh_operate() says so right away */
+swh *swh_open(const char *host, swh_output_fn f_output, swh_done_fn f_done,
+              void *ctx);
+
+/* Not from within the session's own callbacks */
+void swh_close(swh *h);
+
+/* Queue the newline-terminated commands in `cmds`, to be run once the
+ * ones before them are done.  -1 if the session is lost */
+int swh_submit(swh *h, const char *cmds, size_t len);
+
+/* Commands submitted but not done yet */
+size_t swh_pending(swh *h);
+
+/* What to poll() for reading; may change, ask every time */
+int swh_fd(swh *h);
+
+/* ms until swh_operate() has to be called even if swh_fd() doesn't
+ * become readable, -1 if there's no such deadline */
+long swh_timeout(swh *h);
+
+/* Make whatever progress can be made without waiting.  1 if we're
+ * logged in and all submitted commands are done, 0 if we're waiting for
+ * the switch, -1 if the session is lost (see swh_error()) */
+int swh_operate(swh *h);
+
+/* Why the session was lost, NULL if it wasn't */
+const char *swh_error(swh *h);
+
+#endif
@@ -0,0 +1,444 @@
+/* push.c - Windowed bulk configuration push; handled by sc
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_PUSH
+
+#include "push.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/acm.h"
+#include "common/common.h"
+#include "common/log.h"
+#include "back/ansiseq.h"
+#include "back/vt.h"
+
+#define VTCOLS 130 /* must match the terminal size sc reports */
+#define BUFSZ 4096
+#define NUMLINES 256
+#define STEMSZ 64
+#define PS1SZ 256
+#define ERRSZ 256
+#define REPLYSZ 1024
+
+
+/* Rather than per character, we send whole lines, several at a time.  What
+ * comes back is de-escaped on a one-line screen.  Each time that line turns
+ * into a bare prompt, the oldest unacknowledged line is done.  A complete
+ * line that looks like an error message, seen while a line is in flight,
+ * means that line was rejected.
+ * The prompt is recognized by its stem, which a line like `hostname` can
+ * change.  So we also watch for the echo of each line we sent: the prompt
+ * it's echoed at acknowledges everything before it, and gives us the stem
+ * from then on.  Once everything sent has been echoed, whatever looks like
+ * a prompt will do, so a line changing the prompt can also be the last */
+
+struct pline {
+	size_t off, len;      /* in `buf`, not counting the newline */
+	unsigned long lineno; /* in what we were given */
+};
+
+struct push {
+	vt *vt;
+	acm *errors; /* what the switch says when it rejects a line */
+	bool rejected; /* flag - `errors` matched the line that left */
+
+	char *buf; /* the lines to push, newline-terminated, back to back */
+	size_t bufsz, bufcnt;
+
+	struct pline *lines;
+	size_t linessz, nlines;
+
+	size_t window;
+	bool resync;        /* just waiting for a prompt, see push_resync() */
+	size_t sent, acked; /* lines sent, and acknowledged by a prompt */
+	bool atprompt;      /* the screen line is a bare prompt */
+	size_t echoed;      /* lines whose echo we've seen */
+	size_t failed;      /* index+1 of the rejected line, 0: none */
+	char errmsg[ERRSZ];
+
+	char stem[STEMSZ]; /* the prompt, up to the context and the '#' */
+	size_t stemlen;
+
+	char ps1[PS1SZ];
+	size_t ps1len;
+
+	char reply[REPLYSZ];
+};
+
+
+static void addline(push *p, const char *ln, size_t len,
+                    unsigned long lineno);
+static int setstem(push *p, const char *ps1, size_t ps1len);
+static void emit(void *ctx, const char *data, size_t len);
+static void reject(void *ctx, size_t id, size_t end);
+static void echo(push *p);
+static bool isprompt(push *p);
+static size_t promptlen(const char *ln, size_t len, const char *stem,
+                        size_t stemlen);
+
+
+push *
+push_new(const char *const *errors)
+{
+	push *p = xmalloc(sizeof *p);
+	p->vt = vt_new(1, VTCOLS, emit, p);
+	p->errors = acm_new();
+	for (const char *const *e = errors; e && *e; e++)
+		if (**e)
+			acm_add(p->errors, *e, strlen(*e));
+	acm_compile(p->errors);
+	(p->buf = xmalloc(p->bufsz = BUFSZ))[0] = '\0';
+	p->lines = xmalloc((p->linessz = NUMLINES) * sizeof *p->lines);
+	p->nlines = p->sent = p->acked = p->failed = 0;
+	p->ps1len = 0;
+	return p;
+}
+
+void
+push_destroy(push *p)
+{
+	if (!p)
+		return;
+
+	vt_destroy(p->vt);
+	acm_destroy(p->errors);
+	free(p->buf);
+	free(p->lines);
+	free(p);
+	return;
+}
+
+int
+push_begin(push *p, const char *data, size_t len, size_t window,
+           const char *ps1, size_t ps1len)
+{
+	p->bufcnt = p->nlines = 0;
+	unsigned long lineno = 0;
+	const char *end = data + len;
+	while (data < end) {
+		const char *nl = memchr(data, '\n', end - data);
+		size_t n = (nl ? nl : end) - data;
+		lineno++;
+
+		while (n && strchr(" \t\r", data[n-1]))
+			n--;
+
+		/* skip blank lines and the ';' comments HP config files
+		 * come with */
+		size_t i = 0;
+		while (i < n && strchr(" \t", data[i]))
+			i++;
+		if (i < n && data[i] != ';')
+			addline(p, data, n, lineno);
+
+		data += n;
+		while (data < end && *data++ != '\n')
+			;
+	}
+
+	if (setstem(p, ps1, ps1len) != 0)
+		return -1;
+
+	p->window = window ? window : 1;
+	p->resync = false;
+	p->sent = p->acked = p->failed = p->echoed = 0;
+	p->atprompt = false;
+	p->errmsg[0] = '\0';
+	vt_begin(p->vt);
+
+	D("pushing %zu lines, window %zu, prompt stem '%s'", p->nlines,
+	  p->window, p->stem);
+	return 0;
+}
+
+int
+push_resync(push *p, const char *ps1, size_t ps1len)
+{
+	if (setstem(p, ps1, ps1len) != 0)
+		return -1;
+
+	/* as if we had sent a line nobody will see */
+	p->bufcnt = p->nlines = 0;
+	p->window = 1;
+	p->resync = true;
+	p->sent = 1;
+	p->acked = p->failed = p->echoed = 0;
+	p->atprompt = false;
+	p->errmsg[0] = '\0';
+	vt_begin(p->vt);
+
+	D("waiting for prompt stem '%s'", p->stem);
+	return 0;
+}
+
+const char *
+push_next(push *p, size_t *len)
+{
+	if (p->resync || p->failed || p->sent == p->nlines)
+		return NULL;
+
+	size_t lim = p->acked + p->window;
+	if (lim > p->nlines)
+		lim = p->nlines;
+	if (p->sent >= lim)
+		return NULL;
+
+	const char *lines = p->buf + p->lines[p->sent].off;
+	*len = p->lines[lim-1].off + p->lines[lim-1].len + 1
+	    - p->lines[p->sent].off;
+	V("sending lines %zu-%zu", p->sent + 1, lim);
+	p->sent = lim;
+	return lines;
+}
+
+size_t
+push_feed(push *p, const char *data, size_t len)
+{
+	struct ansiseq seq;
+	size_t i = 0;
+	while (i < len) {
+		if (data[i] == '\033') {
+			int r = ansiseq_eatone((const uint8_t *)data + i,
+			                       len - i, &seq);
+			if (r == -1)
+				break; /* need more data */
+			if (r == -2) {
+				i++; /* garbage, skip the ESC */
+				continue;
+			}
+
+			vt_seq(p->vt, &seq);
+			i += r;
+		} else {
+			/* an echo is complete once its last character is
+			 * drawn; only look then, so one echo counts once */
+			unsigned char c = data[i++];
+			vt_putc(p->vt, c);
+			if (c > ' ' && c != 0x7f)
+				echo(p);
+		}
+
+		bool pr = isprompt(p);
+		if (pr && !p->atprompt) {
+			if (p->acked < p->sent) {
+				p->acked++;
+				size_t ln;
+				const char *ps1 = vt_line(p->vt, 0, &ln);
+				setstem(p, ps1, ln);
+				V("line %zu acknowledged", p->acked);
+			} else
+				D("prompt, but nothing in flight");
+		}
+		p->atprompt = pr;
+	}
+
+	return i;
+}
+
+bool
+push_done(push *p)
+{
+	if (p->resync)
+		return p->acked;
+
+	return p->acked == p->sent && (p->failed || p->sent == p->nlines);
+}
+
+unsigned long
+push_failed(push *p)
+{
+	return p->failed ? p->lines[p->failed-1].lineno : 0;
+}
+
+const char *
+push_reply(push *p, size_t *len)
+{
+	if (!p->failed) {
+		*len = snprintf(p->reply, sizeof p->reply, "pushed %zu lines\n",
+		                p->nlines);
+		return p->reply;
+	}
+
+	const struct pline *l = &p->lines[p->failed-1];
+	int n = snprintf(p->reply, sizeof p->reply, "line %lu rejected: "
+	                 "'%.*s': %s\n", l->lineno, (int)l->len,
+	                 p->buf + l->off, p->errmsg);
+	if (n >= 0 && (size_t)n < sizeof p->reply && p->sent > p->failed)
+		n += snprintf(p->reply + n, sizeof p->reply - n, "(%zu lines "
+		              "after it had been sent already)\n",
+		              p->sent - p->failed);
+
+	*len = n < 0 ? 0 : (size_t)n < sizeof p->reply ? (size_t)n
+	    : sizeof p->reply - 1;
+	return p->reply;
+}
+
+const char *
+push_ps1(push *p, size_t *len)
+{
+	*len = p->ps1len;
+	return p->ps1;
+}
+
+
+
+static void
+addline(push *p, const char *ln, size_t len, unsigned long lineno)
+{
+	if (p->nlines == p->linessz)
+		p->lines = xrealloc(p->lines,
+		                    (p->linessz *= 2) * sizeof *p->lines);
+
+	growbuf(&p->buf, &p->bufsz, p->bufcnt + len + 2);
+	p->lines[p->nlines++] = (struct pline){p->bufcnt, len, lineno};
+	memcpy(p->buf + p->bufcnt, ln, len);
+	p->bufcnt += len;
+	p->buf[p->bufcnt++] = '\n';
+	p->buf[p->bufcnt] = '\0';
+	return;
+}
+
+/* what we recognize the prompt by: `ps1` up to the context and '#' */
+static int
+setstem(push *p, const char *ps1, size_t ps1len)
+{
+	p->stemlen = 0;
+	while (p->stemlen < ps1len && p->stemlen < sizeof p->stem - 1
+	    && !strchr("(#> ", ps1[p->stemlen])) {
+		p->stem[p->stemlen] = ps1[p->stemlen];
+		p->stemlen++;
+	}
+	p->stem[p->stemlen] = '\0';
+
+	if (!p->stemlen) {
+		W("can't make sense of prompt '%.*s'", (int)ps1len, ps1);
+		return -1;
+	}
+
+	memcpy(p->ps1, ps1, p->ps1len = ps1len < PS1SZ ? ps1len : PS1SZ - 1);
+	return 0;
+}
+
+/* a line left the screen; complain if it's an error message */
+static void
+emit(void *ctx, const char *data, size_t len)
+{
+	push *p = ctx;
+	if (p->resync || p->failed || p->acked == p->sent
+	    || (len == 1 && data[0] == '\n'))
+		return;
+
+	p->rejected = false;
+	acm_scan(p->errors, 0, data, len, reject, p);
+	if (!p->rejected)
+		return;
+
+	p->failed = p->acked + 1;
+	snprintf(p->errmsg, sizeof p->errmsg, "%.*s", (int)len, data);
+	N("line %lu rejected: %s", p->lines[p->acked].lineno, p->errmsg);
+	return;
+}
+
+/* one of the error messages is in the line */
+static void
+reject(void *ctx, size_t id, size_t end)
+{
+	(void)id, (void)end;
+	push *p = ctx;
+	p->rejected = true;
+	return;
+}
+
+/* the screen line is a prompt followed by the oldest line we sent that
+ * hasn't been echoed yet */
+static void
+echo(push *p)
+{
+	if (p->resync || p->echoed == p->sent)
+		return;
+
+	const struct pline *l = &p->lines[p->echoed];
+	const char *text = p->buf + l->off;
+	size_t len;
+	const char *ln = vt_line(p->vt, 0, &len);
+	if (len < l->len || ln[len-1] != text[l->len-1]
+	    || memcmp(ln + len - l->len, text, l->len) != 0)
+		return;
+
+	/* the first line is echoed at the prompt we had when we started,
+	 * which the screen hasn't seen */
+	size_t plen = len - l->len;
+	size_t n = promptlen(ln, plen, NULL, 0);
+	if (n != plen) {
+		while (plen && ln[plen-1] == ' ')
+			plen--;
+		if (plen)
+			return;
+	}
+
+	p->echoed++;
+	V("line %zu echoed", p->echoed);
+	if (p->acked < p->echoed - 1) {
+		D("lines %zu-%zu acknowledged by the echo", p->acked + 1,
+		  p->echoed - 1);
+		p->acked = p->echoed - 1;
+	}
+
+	if (n)
+		setstem(p, ln, n);
+	return;
+}
+
+/* the screen line is just the prompt: our stem (or, if all we're waiting
+ * for is the prompt after the last line we sent, anything without a
+ * blank in it), maybe a "(context)", then '#' or '>' and a blank */
+static bool
+isprompt(push *p)
+{
+	size_t len;
+	const char *ln = vt_line(p->vt, 0, &len);
+	size_t n;
+	if (!p->resync && p->echoed == p->sent && p->sent)
+		n = promptlen(ln, len, NULL, 0);
+	else
+		n = promptlen(ln, len, p->stem, p->stemlen);
+
+	return n && n == len;
+}
+
+/* length of the prompt at the start of `ln`, 0 if there's none; see
+ * isprompt().  `stem` NULL for any */
+static size_t
+promptlen(const char *ln, size_t len, const char *stem, size_t stemlen)
+{
+	size_t i = 0;
+	if (stem) {
+		if (len < stemlen || memcmp(ln, stem, stemlen) != 0)
+			return 0;
+		i = stemlen;
+	} else
+		while (i < len && !strchr("(#> ", ln[i]))
+			i++;
+
+	if (!i)
+		return 0;
+
+	if (i < len && ln[i] == '(') {
+		while (i < len && ln[i] != ')')
+			i++;
+		i++;
+	}
+
+	if (i + 2 > len || (ln[i] != '#' && ln[i] != '>') || ln[i+1] != ' ')
+		return 0;
+
+	return i + 2;
+}
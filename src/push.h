@@ -0,0 +1,47 @@
+/* push.h - Windowed bulk configuration push; handled by sc
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef PUSH_H
+#define PUSH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct push push;
+
+/* `errors` is a NULL-terminated list of what the switch says when it
+ * rejects a line, see fsm_cmdout_errors() */
+push *push_new(const char *const *errors);
+void push_destroy(push *p);
+
+/* Start pushing the lines in `data`, keeping up to `window` of them in
+ * flight ahead of the prompts acknowledging them.  `ps1` is the prompt
+ * the switch is currently showing.  -1 if we can't make sense of it */
+int push_begin(push *p, const char *data, size_t len, size_t window,
+               const char *ps1, size_t ps1len);
+
+/* Don't push anything, just wait for the prompt `ps1` (give or take the
+ * context) to come back, e.g. after interrupting a command.  push_done()
+ * once it has; -1 if we can't make sense of `ps1` */
+int push_resync(push *p, const char *ps1, size_t ps1len);
+
+/* The lines we may send right now, NULL if none.  They count as sent. */
+const char *push_next(push *p, size_t *len);
+
+/* What the switch said; returns how much of it was consumed */
+size_t push_feed(push *p, const char *data, size_t len);
+
+/* Everything was sent and acknowledged, or a line was rejected and
+ * everything sent up to then was acknowledged */
+bool push_done(push *p);
+
+/* Line number (in `data`) of the first line rejected, 0 if none was */
+unsigned long push_failed(push *p);
+
+/* Summary of the push and the prompt we ended up at; valid until the
+ * next push_begin() */
+const char *push_reply(push *p, size_t *len);
+const char *push_ps1(push *p, size_t *len);
+
+#endif
@@ -0,0 +1,143 @@
+/* replay.c - Session context to restore after reconnecting; handled by core
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_REPLAY
+
+#include "replay.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "common/log.h"
+
+#define MAXDEPTH 8
+#define CTXSZ 64
+#define CMDSZ 512
+
+
+/* One level of configuration context: "configure" took us to "config",
+ * "vlan 10" from there to "vlan-10", etc. */
+struct level {
+	char ctx[CTXSZ];
+	char cmd[CMDSZ];
+	size_t cmdlen;
+};
+
+struct replay {
+	struct level levels[MAXDEPTH];
+	size_t depth;
+};
+
+
+static size_t context(char *dest, const char *ps1, size_t ps1len);
+
+
+replay *
+replay_new(void)
+{
+	replay *r = xmalloc(sizeof *r);
+	r->depth = 0;
+	return r;
+}
+
+void
+replay_destroy(replay *r)
+{
+	free(r);
+	return;
+}
+
+void
+replay_note(replay *r, const char *cmd, size_t cmdlen,
+            const char *ps1a, size_t ps1alen,
+            const char *ps1b, size_t ps1blen)
+{
+	char a[CTXSZ], b[CTXSZ];
+	context(a, ps1a, ps1alen);
+	if (!context(b, ps1b, ps1blen)) {
+		if (r->depth)
+			D("back at top level");
+		r->depth = 0;
+		return;
+	}
+
+	if (strcmp(a, b) == 0)
+		return;
+
+	/* left a context we had entered; "exit" and the like */
+	for (size_t i = 0; i < r->depth; i++) {
+		if (strcmp(r->levels[i].ctx, b) == 0) {
+			D("back in '%s' (depth %zu)", b, i + 1);
+			r->depth = i + 1;
+			return;
+		}
+	}
+
+	if (r->depth == MAXDEPTH || cmdlen >= CMDSZ) {
+		W("can't keep track of context '%s', forgetting all", b);
+		r->depth = 0;
+		return;
+	}
+
+	struct level *l = &r->levels[r->depth++];
+	snprintf(l->ctx, sizeof l->ctx, "%s", b);
+	memcpy(l->cmd, cmd, l->cmdlen = cmdlen);
+	D("entered '%s' by '%.*s' (depth %zu)", b, (int)cmdlen - 1, cmd,
+	  r->depth);
+	return;
+}
+
+void
+replay_clear(replay *r)
+{
+	r->depth = 0;
+	return;
+}
+
+const char *
+replay_cmd(replay *r, size_t i, size_t *len, const char **ctx)
+{
+	if (i >= r->depth)
+		return NULL;
+
+	*len = r->levels[i].cmdlen;
+	*ctx = r->levels[i].ctx;
+	return r->levels[i].cmd;
+}
+
+bool
+replay_incontext(const char *ctx, const char *ps1, size_t ps1len)
+{
+	char c[CTXSZ];
+	context(c, ps1, ps1len);
+	return strcmp(c, ctx) == 0;
+}
+
+
+
+/* the "config" in "HP-2920(config)# "; returns its length, 0 if there's
+ * none */
+static size_t
+context(char *dest, const char *ps1, size_t ps1len)
+{
+	dest[0] = '\0';
+	const char *op = memchr(ps1, '(', ps1len);
+	if (!op)
+		return 0;
+
+	const char *cl = memchr(op, ')', ps1len - (op - ps1));
+	if (!cl || cl - op - 1 >= CTXSZ)
+		return 0;
+
+	size_t len = cl - op - 1;
+	memcpy(dest, op + 1, len);
+	dest[len] = '\0';
+	return len;
+}
@@ -0,0 +1,35 @@
+/* replay.h - Session context to restore after reconnecting; handled by core
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Keeps track of the commands that got us into the configuration
+ * context we're in, going by the "(...)" part of the prompt, so a new
+ * session can be brought back there.  Terminal settings like "no page"
+ * aren't our business; the backend's setup commands take care of them */
+typedef struct replay replay;
+
+replay *replay_new(void);
+void replay_destroy(replay *r);
+
+/* `cmd` took the switch from prompt `ps1a` to prompt `ps1b` */
+void replay_note(replay *r, const char *cmd, size_t cmdlen,
+                 const char *ps1a, size_t ps1alen,
+                 const char *ps1b, size_t ps1blen);
+
+/* Forget about it, we're at the top level */
+void replay_clear(replay *r);
+
+/* The `i`th command (newline-terminated) to replay, NULL past the last.
+ * `*ctx` is set to the context it should take us to */
+const char *replay_cmd(replay *r, size_t i, size_t *len, const char **ctx);
+
+/* Is prompt `ps1` in context `ctx`? */
+bool replay_incontext(const char *ctx, const char *ps1, size_t ps1len);
+
+#endif
@@ -10,307 +10,957 @@
 
 #include "sc.h"
 
+#include <errno.h>
+#include <stdarg.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <unistd.h>
+#include <sys/types.h>
 
 #include "common/log.h"
 #include "common/common.h"
-#include "spawn.h"
+#include "push.h"
+#include "xport/xport.h"
 #include "back/fsm.h"
 #include "back/fsm_init.h"
 #include "back/fsm_cmdout.h"
 #include "back/fsm_inchar.h"
+#include "back/def/def.h"
 
 #define BUSY 0
 #define READY 1
 #define WRITING 2
 #define OFFLINE 3
+#define PUSHING 4
+#define CANCELLING 5 /* interrupted a command, waiting for the prompt */
 
 // initial sizes, buffers will grow on demand
 #define READBUFSZ 4096
-#define OUTBUFSZ 4096
-#define PS1BUFSZ 128
 #define WRITEBUFSZ 4096
+#define QUEUEBUFSZ 256
 
+// buffers grown beyond this are trimmed once we're READY again
+#define TRIMBUFSZ (64 * 1024)
+
+/* what the switch said but no FSM has eaten yet; more than this and
+ * it's not making sense to them */
+#define READBUFMAX (1024 * 1024)
+
+/* when streaming, stop reading once this much rendered output hasn't
+ * been sc_consume()d yet; the switch waits on its side meanwhile */
+#define STREAMHIWAT (256 * 1024)
+
+#define ERRSZ 256
+#define PS1SZ 256
+
+/* how much of what the switch says we look at to tell what it is */
+#define DETECTSZ 4096
 
-static bool s_nodataflag;
-static int s_state;
-static int s_stdin, s_stdout, s_stderr;
+/* after interrupting a command, how long the switch has to come back
+ * with a prompt before we give up on it */
+#define CANCEL_MS 5000
 
-static char *s_readbuf;
-static size_t s_readbufsz, s_readbufcnt;
 
-static char *s_writebuf;
-static size_t s_writebufsz, s_writebufcnt;
+/* a completed command from the queue; `data` is cmd, reply and the
+ * prompt it was sent at */
+struct result {
+	char *data;
+	size_t cmdlen, replylen, ps1len;
+	bool timedout;
+};
 
-static char *s_ps1buf;
-static size_t s_ps1bufsz, s_ps1bufcnt;
+/* One session with one switch.  Everything a session needs lives here,
+ * so that any number of them can be operated side by side */
+struct sc {
+	bool quiet; /* current command is ours, don't report its output */
+	int state;
+	xport *x;           /* NULL until sc_start() */
+	uint64_t holduntil; /* don't read before this, see sc_holdoff() */
+	int backend;        /* -1 until we know, see detect() */
 
-static char *s_outbuf;
-static size_t s_outbufsz, s_outbufcnt;
+	unsigned long loginms, cmdms; /* see sc_deadlines() */
+	uint64_t deadline; /* for whatever we're doing, 0 if none */
+	bool timedout;     /* the last command was interrupted */
 
-static fsm *s_fsm_init;
-static fsm *s_fsm_cmdout;
-static fsm *s_fsm_inchar;
-static fsm *s_curfsm;
+	/* the prompt we sent the current command at, for resyncing */
+	char cmdps1[PS1SZ];
+	size_t cmdps1len;
 
+	char *readbuf;
+	size_t readbufsz, readbufcnt;
 
-static ssize_t read_more(void);
-static int oper_writing(void);
-static int oper_busy(void);
+	char *writebuf;
+	size_t writebufsz, writebufcnt;
 
+	/* reply and prompt point into the buffers of whatever FSM produced
+	 * them; we don't copy them, see sc_getreply() and sc_getps1() */
+	const char *reply;
+	size_t replylen;
 
-void
+	const char *ps1;
+	size_t ps1len;
+
+	tbl *tbl;      /* NULL unless someone wants rows, see sc_setrows() */
+	size_t parsed; /* how much of the cmdout FSM's output tbl has */
+
+	bool streaming; /* see sc_setstreaming() */
+
+	push *push; /* created on the first sc_push() */
+
+	/* commands from sc_queue() not sent yet, newline-terminated */
+	char *queue;
+	size_t queuesz, queuecnt;
+
+	/* the one of them in flight, if any */
+	char *qcmd;
+	size_t qcmdsz, qcmdlen;
+
+	/* their replies, copied since the FSMs' buffers get reused for the
+	 * next one right away; [resfirst, rescnt) haven't been taken yet */
+	struct result *res;
+	size_t ressz, resfirst, rescnt;
+	char *taken; /* what sc_take() handed out last time */
+
+	fsm *fsm_init;
+	fsm *fsm_cmdout;
+	fsm *fsm_inchar;
+	fsm *curfsm;
+
+	char error[ERRSZ]; /* why we went OFFLINE */
+};
+
+
+static void enqueue(sc *s, const char *str, size_t len);
+static void parse_output(sc *s);
+static int attach(const char *backend);
+static void mkfsms(sc *s);
+static int detect(sc *s);
+static ssize_t read_more(sc *s);
+static bool writesw(sc *s, const char *data, size_t len);
+static int oper_writing(sc *s);
+static int oper_busy(sc *s);
+static bool paused(sc *s);
+static int oper_pushing(sc *s);
+static int oper_cancelling(sc *s);
+static int expired(sc *s);
+static void become_ready(sc *s);
+static void sendnext(sc *s);
+static int fail(sc *s, const char *fmt, ...);
+
+
+static unsigned long s_loginms = 30000;
+static unsigned long s_cmdms = 0;
+static int s_backend = -1; /* -1: every session finds out for itself */
+static bool s_wantdef;      /* we were given a definition */
+
+
+/* attach the backend all sessions are going to use.  with "auto", we
+ * attach them all and each session picks one by the switch's banner */
+int
 sc_init(const char *backend)
 {
-	V("allocating and initializing buffers");
-	(s_readbuf = xmalloc(s_readbufsz = READBUFSZ))[0] = '\0';
-	(s_writebuf = xmalloc(s_writebufsz = WRITEBUFSZ))[0] = '\0';
-	(s_ps1buf = xmalloc(s_ps1bufsz = PS1BUFSZ))[0] = '\0';
-	(s_outbuf = xmalloc(s_outbufsz = OUTBUFSZ))[0] = '\0';
+	if (strcmp(backend, "auto") == 0) {
+#define X(IFNAME) attach(#IFNAME);
+#include "back/backends.h"
+#undef X
+	} else
+		s_backend = attach(backend);
+
+	/* attaching it may have found the definition wanting, too */
+	if ((s_wantdef || strcmp(backend, "def") == 0) && !def_loaded()) {
+		E("backend 'def' needs a (working) definition");
+		return -1;
+	}
 
-	fsm_init_attach(backend);
-	fsm_cmdout_attach(backend);
-	fsm_inchar_attach(backend);
+	I("sc initialized");
+	return 0;
+}
 
-	s_fsm_init = fsm_init_init();
-	s_fsm_cmdout = fsm_cmdout_init();
-	s_fsm_inchar = fsm_inchar_init();
+/* load the definition for the def backend; before sc_init() */
+int
+sc_loaddef(const char *path)
+{
+	s_wantdef = true;
+	return def_load(path);
+}
 
-	s_curfsm = s_fsm_init;
+/* defaults for sessions created from now on; 0 means no deadline */
+void
+sc_deadlines(unsigned long login_ms, unsigned long cmd_ms)
+{
+	s_loginms = login_ms;
+	s_cmdms = cmd_ms;
+	return;
+}
 
-	//fsm_init();
-	//V("resetting fsm, program init");
-	//fsm_reset(0); // loads init program
+sc *
+sc_new(void)
+{
+	sc *s = xmalloc(sizeof *s);
+	memset(s, 0, sizeof *s);
 
-	I("sc initialized");
+	V("allocating and initializing buffers");
+	(s->readbuf = xmalloc(s->readbufsz = READBUFSZ))[0] = '\0';
+	(s->writebuf = xmalloc(s->writebufsz = WRITEBUFSZ))[0] = '\0';
+	(s->queue = xmalloc(s->queuesz = QUEUEBUFSZ))[0] = '\0';
+	(s->qcmd = xmalloc(s->qcmdsz = QUEUEBUFSZ))[0] = '\0';
+
+	s->backend = s_backend;
+	if (s->backend != -1)
+		mkfsms(s);
+
+	s->loginms = s_loginms;
+	s->cmdms = s_cmdms;
+	s->reply = s->ps1 = "";
+	s->state = OFFLINE;
+	snprintf(s->error, sizeof s->error, "not started");
+	return s;
+}
+
+/* hangs up, if connected; the reply and prompt are gone after this */
+void
+sc_destroy(sc *s)
+{
+	if (!s)
+		return;
+
+	xport_close(s->x);
+
+	fsm_init_destroy(s->fsm_init);
+	fsm_cmdout_destroy(s->fsm_cmdout);
+	fsm_inchar_destroy(s->fsm_inchar);
+	push_destroy(s->push);
+	tbl_destroy(s->tbl);
+	for (size_t i = s->resfirst; i < s->rescnt; i++)
+		free(s->res[i].data);
+	free(s->res);
+	free(s->taken);
+	free(s->queue);
+	free(s->qcmd);
+	free(s->readbuf);
+	free(s->writebuf);
+	free(s);
 	return;
 }
 
-int
-sc_start(const char *host)
+void
+sc_setrows(sc *s, tbl_row_fn f_row, void *ctx)
 {
-	D("calling spawn to launch ssh");
-	if (spawn_launch(host, &s_stdin, &s_stdout, &s_stderr) != 0)
-		C("could not spawn ssh");
+	tbl_destroy(s->tbl);
+	s->tbl = f_row ? tbl_new(f_row, ctx) : NULL;
+	return;
+}
 
-	D("going nonblocking");
-	setblocking(s_stdout, false);
+int
+sc_start(sc *s, const char *host)
+{
+	D("connecting to '%s'", host);
+	if (!(s->x = xport_open(host))) {
+		fail(s, "could not connect");
+		return -1;
+	}
 
-	D("spawned ssh");
+	V("state changed to BUSY");
+	s->state = BUSY;
+	if (s->loginms)
+		s->deadline = timestamp_ms() + s->loginms;
+	D("connection under way");
 	return 0;
 }
 
 int
-sc_operate(void)
+sc_operate(sc *s)
 {
-	switch (s_state) {
+	if (s->deadline && timestamp_ms() >= s->deadline)
+		return expired(s);
+
+	switch (s->state) {
 	case WRITING:
-		return oper_writing();
+		return oper_writing(s);
 	case BUSY:
-		return oper_busy();
+		return oper_busy(s);
+	case PUSHING:
+		return oper_pushing(s);
+	case CANCELLING:
+		return oper_cancelling(s);
 	case READY:
 		C("cannot operate while ready");
 	case OFFLINE:
 		C("cannot operate while offline");
 	default:
-		C("invalid state %d", s_state);
+		C("invalid state %d", s->state);
 	}
 }
 
 void
-sc_write(const char *str, size_t len)
+sc_write(sc *s, const char *str, size_t len)
 {
-	if (s_state != READY)
+	if (s->state != READY)
 		C("attempt to write outside READY state");
-	if (s_writebufcnt)
+	if (s->writebufcnt)
 		C("write buffer not empty");
 
-	growbuf(&s_writebuf, &s_writebufsz, s_writebufcnt + len + 1);
-	memcpy(s_writebuf + s_writebufcnt, str, len);
-	s_writebufcnt += len;
-	s_writebuf[s_writebufcnt] = '\0';
+	s->cmdps1len = s->ps1len < PS1SZ ? s->ps1len : PS1SZ - 1;
+	memcpy(s->cmdps1, s->ps1, s->cmdps1len);
+	s->timedout = false;
+	if (s->cmdms)
+		s->deadline = timestamp_ms() + s->cmdms;
 
-	D("queued %zu bytes (%.*s) to switch", len, (int)len, str);
-	V("state changed to WRITING");
-	s_state = WRITING;
-	V("purging outbuf");
-	s_outbufcnt = 0;
-	s_outbuf[0] = '\0';
+	enqueue(s, str, len);
+	if (s->tbl)
+		tbl_begin(s->tbl, str, len);
 	return;
 }
 
+void
+sc_queue(sc *s, const char *cmds, size_t len)
+{
+	if (!len || cmds[len-1] != '\n')
+		C("queued commands don't end in a newline");
+
+	growbuf(&s->queue, &s->queuesz, s->queuecnt + len + 1);
+	memcpy(s->queue + s->queuecnt, cmds, len);
+	s->queuecnt += len;
+
+	if (s->state == READY)
+		sendnext(s);
+	return;
+}
+
+size_t
+sc_pending(sc *s)
+{
+	size_t n = s->qcmdlen ? 1 : 0;
+	for (size_t i = 0; i < s->queuecnt; i++)
+		if (s->queue[i] == '\n')
+			n++;
+	return n;
+}
+
 bool
-sc_hasreply(void)
+sc_take(sc *s, struct sc_result *r)
+{
+	if (s->resfirst == s->rescnt)
+		return false;
+
+	struct result *e = &s->res[s->resfirst++];
+	free(s->taken);
+	s->taken = e->data;
+
+	r->cmd = e->data;
+	r->cmdlen = e->cmdlen;
+	r->reply = r->cmd + e->cmdlen;
+	r->replylen = e->replylen;
+	r->ps1 = r->reply + e->replylen;
+	r->ps1len = e->ps1len;
+	r->timedout = e->timedout;
+
+	if (s->resfirst == s->rescnt)
+		s->resfirst = s->rescnt = 0;
+	return true;
+}
+
+bool
+sc_inflight(sc *s, struct sc_result *r)
+{
+	if (!s->qcmdlen)
+		return false;
+
+	r->cmd = s->qcmd;
+	r->cmdlen = s->qcmdlen;
+	r->reply = "";
+	r->replylen = 0;
+	r->ps1 = s->cmdps1;
+	r->ps1len = s->cmdps1len;
+	r->timedout = false;
+	return true;
+}
+
+int
+sc_push(sc *s, const char *data, size_t len, size_t window)
 {
-	return s_outbufcnt;
+	if (s->state != READY)
+		C("attempt to push outside READY state");
+
+	if (!s->push)
+		s->push = push_new(fsm_cmdout_errors(s->fsm_cmdout));
+
+	if (push_begin(s->push, data, len, window, s->ps1, s->ps1len) != 0)
+		return -1;
+
+	s->reply = "";
+	s->replylen = 0;
+	s->timedout = false;
+	if (s->cmdms)
+		s->deadline = timestamp_ms() + s->cmdms;
+	V("state changed to PUSHING");
+	s->state = PUSHING;
+	return 0;
+}
+
+unsigned long
+sc_pushfailed(sc *s)
+{
+	return s->push ? push_failed(s->push) : 0;
+}
+
+bool
+sc_hasreply(sc *s)
+{
+	return s->replylen;
 }
 
 const char *
-sc_getreply(void)
+sc_getreply(sc *s, size_t *len)
 {
-	return s_outbuf;
+	*len = s->replylen;
+	return s->reply;
+}
+
+void
+sc_setstreaming(sc *s, bool on)
+{
+	s->streaming = on;
+	return;
 }
 
 const char *
-sc_getps1(void)
+sc_peekreply(sc *s, size_t *len)
 {
-	return s_ps1buf;
+	/* until BUSY, the cmdout FSM may still have the last reply */
+	if (!s->streaming || s->state != BUSY || !s->curfsm
+	    || s->curfsm != s->fsm_cmdout || s->quiet) {
+		*len = 0;
+		return "";
+	}
+
+	*len = fsm_cmdout_outbufcnt(s->fsm_cmdout);
+	return fsm_cmdout_outbuf(s->fsm_cmdout);
+}
+
+void
+sc_consume(sc *s, size_t len)
+{
+	if (!len)
+		return;
+
+	/* tbl has to have seen it before it's gone */
+	parse_output(s);
+	fsm_cmdout_outdrop(s->fsm_cmdout, len);
+	s->parsed = s->parsed > len ? s->parsed - len : 0;
+	return;
+}
+
+bool
+sc_paused(sc *s)
+{
+	return s->state == BUSY && paused(s);
+}
+
+const char *
+sc_getps1(sc *s, size_t *len)
+{
+	*len = s->ps1len;
+	return s->ps1;
+}
+
+bool
+sc_busy(sc *s)
+{
+	return !sc_ready(s) && !sc_offline(s);
 }
 
 bool
-sc_busy(void)
+sc_offline(sc *s)
 {
-	return !sc_ready() && !sc_offline();
+	return s->state == OFFLINE;
 }
 
 bool
-sc_offline(void)
+sc_ready(sc *s)
 {
-	return s_state == OFFLINE;
+	return s->state == READY;
 }
 
 bool
-sc_ready(void)
+sc_timedout(sc *s)
+{
+	return s->timedout;
+}
+
+long
+sc_timeout(sc *s)
+{
+	if (!s->deadline)
+		return -1;
+
+	uint64_t now = timestamp_ms();
+	return s->deadline > now ? (long)(s->deadline - now) : 0;
+}
+
+const char *
+sc_error(sc *s)
+{
+	return s->state == OFFLINE ? s->error : NULL;
+}
+
+unsigned long
+sc_holdoff(sc *s)
 {
-	return s_state == READY;
+	if (!s->holduntil)
+		return 0;
+
+	uint64_t now = timestamp_ms();
+	return s->holduntil > now ? s->holduntil - now : 0;
 }
 
 int
-sc_getfd(void)
+sc_getfd(sc *s)
+{
+	return s->x ? xport_fd(s->x) : -1;
+}
+
+
+
+static void
+enqueue(sc *s, const char *str, size_t len)
 {
-	return s_stdout;
+	growbuf(&s->writebuf, &s->writebufsz, s->writebufcnt + len + 1);
+	memcpy(s->writebuf + s->writebufcnt, str, len);
+	s->writebufcnt += len;
+	s->writebuf[s->writebufcnt] = '\0';
+
+	D("queued %zu bytes (%.*s) to switch", len, (int)len, str);
+	V("state changed to WRITING");
+	s->state = WRITING;
+	V("dropping reply");
+	s->reply = "";
+	s->replylen = 0;
+	return;
 }
 
+/* hand tbl whatever output the cmdout FSM has rendered since last time */
+static void
+parse_output(sc *s)
+{
+	if (!s->tbl)
+		return;
 
+	size_t cnt = fsm_cmdout_outbufcnt(s->fsm_cmdout);
+	if (cnt <= s->parsed)
+		return;
 
+	tbl_feed(s->tbl, fsm_cmdout_outbuf(s->fsm_cmdout) + s->parsed,
+	         cnt - s->parsed);
+	s->parsed = cnt;
+	return;
+}
+
+/* hook up the FSMs of `backend`; returns its index */
+static int
+attach(const char *backend)
+{
+	int b = fsm_init_attach(backend);
+	fsm_cmdout_attach(backend);
+	fsm_inchar_attach(backend);
+	return b;
+}
+
+static void
+mkfsms(sc *s)
+{
+	s->fsm_init = fsm_init_new(s->backend);
+	s->fsm_cmdout = fsm_cmdout_new(s->backend);
+	s->fsm_inchar = fsm_inchar_new(s->backend);
+	s->curfsm = s->fsm_init;
+	return;
+}
+
+/* we don't know what kind of switch this is yet; hold on to what it
+ * says until a backend recognizes it, then hand it to that one's FSMs */
+static int
+detect(sc *s)
+{
+	int b = fsm_init_detect((const uint8_t *)s->readbuf, s->readbufcnt);
+	if (b == -2)
+		return fail(s, "unknown kind of switch");
+
+	if (b == -1) {
+		if (s->readbufcnt >= DETECTSZ)
+			return fail(s, "can't tell what kind of switch this is");
+		return 0;
+	}
+
+	s->backend = b;
+	mkfsms(s);
+	return 1;
+}
+
+/* returns the number of bytes read, 0 on EAGAIN, -1 if we lost the
+ * switch and are OFFLINE now */
 static ssize_t
-read_more(void)
+read_more(sc *s)
 {
 	size_t remain;
-	remain = s_readbufsz - s_readbufcnt;
+	remain = s->readbufsz - s->readbufcnt;
 	if (!remain) {
+		if (s->readbufsz >= READBUFMAX)
+			return fail(s, "%zu bytes of output we can't make "
+			            "sense of", s->readbufcnt);
 		N("growing readbuf");
-		growbuf(&s_readbuf, &s_readbufsz, s_readbufsz * 2);
+		growbuf(&s->readbuf, &s->readbufsz, s->readbufsz * 2);
 	}
-	remain = s_readbufsz - s_readbufcnt;
+	remain = s->readbufsz - s->readbufcnt;
 
 	V("trying to read more data (%zu bytes space in readbuf)", remain);
-	ssize_t r = xread(s_stdout, s_readbuf + s_readbufcnt, remain);
+	ssize_t r = xport_read(s->x, s->readbuf + s->readbufcnt, remain);
 	if (r == -1) {
-		V("EAGAIN (rbc %zu)", s_readbufcnt);
-		return 0;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			V("EAGAIN (rbc %zu)", s->readbufcnt);
+			return 0;
+		}
+		return fail(s, "read: %s", strerror(errno));
 	}
 	if (r == 0)
-		C("read: EOF");
+		return fail(s, "connection closed");
 
 	D("read from switch: %zd bytes", r);
-	s_readbufcnt += (size_t)r;
-	hexdump(s_readbuf, s_readbufcnt, "readbuf");
+	s->readbufcnt += (size_t)r;
+	hexdump(s->readbuf, s->readbufcnt, "readbuf");
 	return r;
 }
 
+/* false if we lost the switch and are OFFLINE now */
+static bool
+writesw(sc *s, const char *data, size_t len)
+{
+	if (xport_write(s->x, data, len))
+		return true;
+
+	fail(s, "write: %s", strerror(errno));
+	return false;
+}
+
 static int
-oper_writing(void)
+oper_writing(sc *s)
 {
 	V("operate in WRITING state");
-	if (!s_writebufcnt)
+	if (!s->writebufcnt)
 		C("line from user didn't end in newline"); //XXX so what
 
-	char c = s_writebuf[0];
+	char c = s->writebuf[0];
 	V("writing 0x%02x aka '%c'", c, c);
-	xwrite(s_stdin, &c, 1);
-	shiftbuf(s_writebuf, &s_writebufcnt, 1);// XXX inefficient
+	if (!writesw(s, &c, 1))
+		return -1;
+	shiftbuf(s->writebuf, &s->writebufcnt, 1);// XXX inefficient
 	if (c == '\n') {
 		V("resetting fsm, program cmdout");
-		s_curfsm = s_fsm_cmdout;
-		fsm_reset(s_curfsm);
+		s->curfsm = s->fsm_cmdout;
+		fsm_reset(s->curfsm);
+		s->parsed = 0;
 	} else {
 		V("resetting fsm, program inchar");
-		s_curfsm = s_fsm_inchar;
-		fsm_reset(s_curfsm);
+		s->curfsm = s->fsm_inchar;
+		fsm_reset(s->curfsm);
 	}
 	V("state changed to BUSY");
-	s_state = BUSY;
+	s->state = BUSY;
 	return 1;
 }
 
 static int
-oper_busy(void)
+oper_busy(sc *s)
 {
 	V("operate in BUSY state");
 
-	if (read_more() || s_readbufcnt) {
-		s_nodataflag = false;
-		size_t r = fsm_feed(s_curfsm, (const uint8_t *)s_readbuf,
-		                    s_readbufcnt);
+	if (s->holduntil) {
+		if (timestamp_ms() < s->holduntil)
+			return 0;
+		s->holduntil = 0;
+	}
+
+	if (paused(s)) {
+		V("paused, %zu bytes of output not consumed",
+		  fsm_cmdout_outbufcnt(s->fsm_cmdout));
+		return 0;
+	}
+
+	ssize_t nr = read_more(s);
+	if (nr == -1)
+		return -1;
+
+	if (s->backend == -1)
+		return nr ? detect(s) : 0;
+
+	if (nr || s->readbufcnt) {
+		size_t r = fsm_feed(s->curfsm, (const uint8_t *)s->readbuf,
+		                    s->readbufcnt);
 		if (r == 0) {
 			W("fsm needs more data");
 			return 0; //need more data
 		}
-		D("fsm ate %zu/%zu", r, s_readbufcnt);
-
-		if (s_curfsm == s_fsm_init) {
-			if (fsm_init_anykey())
-				xwrite(s_stdin, "x", 1);
-
-			if (fsm_init_report()) {
-				xwrite(s_stdin, "\033[9999;130R", 11);
-				msleep(100); //XXX HP quirk, move this
+		D("fsm ate %zu/%zu", r, s->readbufcnt);
+
+		if (s->curfsm == s->fsm_init) {
+			if (fsm_init_anykey(s->fsm_init) && !writesw(s, "x", 1))
+				return -1;
+
+			if (fsm_init_report(s->fsm_init)) {
+				/* the HP cmdout FSM renders on a screen this size */
+				if (!writesw(s, "\033[9999;130R", 11))
+					return -1;
+				//XXX HP quirk, move this
+				s->holduntil = timestamp_ms() + 100;
+			}
+		} else if (s->curfsm == s->fsm_cmdout) {
+			if (fsm_cmdout_more(s->fsm_cmdout)) {
+				D("pager wants a keypress, obliging");
+				if (!writesw(s, " ", 1))
+					return -1;
 			}
+
+			parse_output(s);
 		}
 
-		shiftbuf(s_readbuf, &s_readbufcnt, r);
+		shiftbuf(s->readbuf, &s->readbufcnt, r);
 
-		if (fsm_error(s_curfsm))
-			C("fsm in error state");
+		if (fsm_error(s->curfsm))
+			return fail(s, "unexpected output from switch");
 
 		return 1;
 	}
 
-	if (fsm_feed(s_curfsm, NULL, 0)) {
-		fsm_feed(s_curfsm, NULL, 1);
-	} else if (!s_nodataflag) {
-		s_nodataflag = true;
+	/* nothing new; unless what we have is complete, wait for more */
+	if (!fsm_feed(s->curfsm, NULL, 0))
 		return 0;
-	} else {
-		C("meh"); //XXX
+
+	fsm_feed(s->curfsm, NULL, 1);
+
+	if (s->curfsm == s->fsm_init) {
+		const char *setup = fsm_init_setup(s->fsm_init);
+		if (setup && *setup) {
+			D("logged in, issuing setup commands");
+			enqueue(s, setup, strlen(setup));
+			s->quiet = true;
+		}
 	}
 
-	if (s_writebufcnt) {
+	if (s->writebufcnt) {
 		V("state changed to WRITING");
-		s_state = WRITING;
+		s->state = WRITING;
 	} else {
-		if (s_outbufcnt)
-			C("why isn't the outbuf empty here"); //XXX
-
-		const char *out = "";
-		if (s_curfsm == s_fsm_cmdout)
-			out = fsm_cmdout_outbuf();
-
-		size_t len = strlen(out);
-		growbuf(&s_outbuf, &s_outbufsz, len+1);
-		memcpy(s_outbuf, out, len);
-		s_outbuf[len] = '\0';
-		s_outbufcnt = len;
-
-		const char *ps1 = "";
-		if (s_curfsm == s_fsm_init)
-			ps1 = fsm_init_ps1buf();
-		else if (s_curfsm == s_fsm_cmdout)
-			ps1 = fsm_cmdout_ps1buf();
-
-		len = strlen(ps1);
-		growbuf(&s_ps1buf, &s_ps1bufsz, len+1);
-		memcpy(s_ps1buf, ps1, len);
-		s_ps1buf[len] = '\0';
-		s_ps1bufcnt = len;
-
-		V("state changed to READY");
-		s_state = READY;
+		/* hand out views into the FSM's buffers rather than copies;
+		 * they stay put until the FSM is reset by the next sc_write */
+		if (s->curfsm == s->fsm_cmdout) {
+			parse_output(s);
+			if (s->tbl)
+				tbl_end(s->tbl);
+
+			s->reply = fsm_cmdout_outbuf(s->fsm_cmdout);
+			s->replylen = fsm_cmdout_outbufcnt(s->fsm_cmdout);
+			s->ps1 = fsm_cmdout_ps1buf(s->fsm_cmdout);
+			s->ps1len = fsm_cmdout_ps1bufcnt(s->fsm_cmdout);
+		} else if (s->curfsm == s->fsm_init) {
+			s->ps1 = fsm_init_ps1buf(s->fsm_init);
+			s->ps1len = fsm_init_ps1bufcnt(s->fsm_init);
+		}
+
+		if (s->quiet) {
+			D("swallowing reply to setup (%zu bytes)", s->replylen);
+			s->reply = "";
+			s->replylen = 0;
+			s->quiet = false;
+		}
+
+		become_ready(s);
 	}
 
 	return 1;
 }
+
+/* streaming, and the caller is behind on taking the output */
+static bool
+paused(sc *s)
+{
+	return s->streaming && s->curfsm && s->curfsm == s->fsm_cmdout
+	    && !s->quiet
+	    && fsm_cmdout_outbufcnt(s->fsm_cmdout) >= STREAMHIWAT;
+}
+
+/* lines are written whole, as many as push lets us, and whatever comes
+ * back goes to push rather than through the FSMs */
+static int
+oper_pushing(sc *s)
+{
+	V("operate in PUSHING state");
+	bool progress = false;
+
+	size_t len;
+	const char *lines = push_next(s->push, &len);
+	if (lines) {
+		D("pushing %zu bytes", len);
+		if (!writesw(s, lines, len))
+			return -1;
+		progress = true;
+	}
+
+	ssize_t nr = read_more(s);
+	if (nr == -1)
+		return -1;
+
+	if (nr || s->readbufcnt) {
+		size_t r = push_feed(s->push, s->readbuf, s->readbufcnt);
+		shiftbuf(s->readbuf, &s->readbufcnt, r);
+		progress = progress || r;
+	}
+
+	/* for a push, the deadline is for the switch to make progress */
+	if (progress && s->cmdms)
+		s->deadline = timestamp_ms() + s->cmdms;
+
+	if (!push_done(s->push))
+		return progress;
+
+	s->reply = push_reply(s->push, &s->replylen);
+	s->ps1 = push_ps1(s->push, &s->ps1len);
+	become_ready(s);
+	return 1;
+}
+
+/* we interrupted the command; everything up to the prompt goes to push,
+ * which tells us when it's back */
+static int
+oper_cancelling(sc *s)
+{
+	V("operate in CANCELLING state");
+
+	ssize_t nr = read_more(s);
+	if (nr == -1)
+		return -1;
+
+	if (!nr && !s->readbufcnt)
+		return 0;
+
+	size_t r = push_feed(s->push, s->readbuf, s->readbufcnt);
+	shiftbuf(s->readbuf, &s->readbufcnt, r);
+	if (!push_done(s->push))
+		return 1;
+
+	D("switch is back at the prompt");
+	s->reply = "";
+	s->replylen = 0;
+	s->ps1 = push_ps1(s->push, &s->ps1len);
+	become_ready(s);
+	return 1;
+}
+
+/* we ran out of time for whatever we were doing.  a command gets
+ * interrupted, which leaves the session usable; everything else means
+ * it isn't */
+static int
+expired(sc *s)
+{
+	s->deadline = 0;
+	if (s->curfsm == s->fsm_init || s->quiet)
+		return fail(s, "login timed out");
+	if (s->state == PUSHING)
+		return fail(s, "push stalled");
+	if (s->state == CANCELLING)
+		return fail(s, "no prompt after interrupting command");
+
+	W("command timed out, interrupting");
+	if (!s->push)
+		s->push = push_new(fsm_cmdout_errors(s->fsm_cmdout));
+
+	if (push_resync(s->push, s->cmdps1, s->cmdps1len) != 0)
+		return fail(s, "command timed out at an odd prompt");
+
+	/* drop the rest of the command, if we're still typing it; the
+	 * output so far goes to push from here on */
+	s->writebufcnt = 0;
+	if (!writesw(s, "\003", 1))
+		return -1;
+
+	if (s->tbl)
+		tbl_end(s->tbl);
+
+	s->timedout = true;
+	s->deadline = timestamp_ms() + CANCEL_MS;
+	V("state changed to CANCELLING");
+	s->state = CANCELLING;
+	return 1;
+}
+
+static void
+become_ready(sc *s)
+{
+	trimbuf(&s->readbuf, &s->readbufsz, s->readbufcnt, READBUFSZ,
+	        TRIMBUFSZ);
+	trimbuf(&s->writebuf, &s->writebufsz, s->writebufcnt,
+	        WRITEBUFSZ, TRIMBUFSZ);
+
+	s->deadline = 0;
+	V("state changed to READY");
+	s->state = READY;
+
+	/* if that was one of the queue's, keep its reply and go on with
+	 * the next one right away */
+	if (s->qcmdlen) {
+		if (s->rescnt == s->ressz)
+			s->res = xrealloc(s->res, (s->ressz = s->ressz
+			                  ? s->ressz * 2 : 8) * sizeof *s->res);
+
+		struct result *e = &s->res[s->rescnt++];
+		e->cmdlen = s->qcmdlen;
+		e->replylen = s->replylen;
+		e->ps1len = s->cmdps1len;
+		e->timedout = s->timedout;
+		e->data = xmalloc(e->cmdlen + e->replylen + e->ps1len + 1);
+		memcpy(e->data, s->qcmd, e->cmdlen);
+		memcpy(e->data + e->cmdlen, s->reply, e->replylen);
+		memcpy(e->data + e->cmdlen + e->replylen, s->cmdps1, e->ps1len);
+		e->data[e->cmdlen + e->replylen + e->ps1len] = '\0';
+		s->qcmdlen = 0;
+	}
+
+	if (s->queuecnt)
+		sendnext(s);
+	return;
+}
+
+/* send the oldest command in the queue */
+static void
+sendnext(sc *s)
+{
+	size_t len = (char *)memchr(s->queue, '\n', s->queuecnt) + 1
+	    - s->queue;
+
+	growbuf(&s->qcmd, &s->qcmdsz, len + 1);
+	memcpy(s->qcmd, s->queue, s->qcmdlen = len);
+	shiftbuf(s->queue, &s->queuecnt, len);
+
+	D("sending queued '%.*s' (%zu more)", (int)len - 1, s->qcmd,
+	  sc_pending(s) - 1);
+	sc_write(s, s->qcmd, len);
+	return;
+}
+
+/* the session is lost; remember why and go OFFLINE.  returns -1 so it
+ * can double as the return value of whatever noticed */
+static int
+fail(sc *s, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(s->error, sizeof s->error, fmt, ap);
+	va_end(ap);
+
+	W("session failed: %s", s->error);
+	s->deadline = 0;
+	V("state changed to OFFLINE");
+	s->state = OFFLINE;
+	return -1;
+}
@@ -7,20 +7,111 @@
 
 #include <stdbool.h>
 #include <stddef.h>
-void sc_init(const char *backend);
 
-int sc_start(const char *host);
-int sc_operate(void);
-void sc_write(const char *str, size_t len);
+#include "tbl.h"
 
-bool sc_hasreply(void);
-const char *sc_getreply(void);
-const char *sc_getps1(void);
+typedef struct sc sc;
 
-bool sc_busy(void);
-bool sc_offline(void);
-bool sc_ready(void);
+/* -1 if `backend` is "def", or sc_loaddef() was called, and there's no
+ * usable definition */
+int sc_init(const char *backend);
 
-int sc_getfd(void);
+/* Load the switch description the "def" backend works off (see
+ * back/def/def.h); has to happen before sc_init().  -1 if it's missing
+ * or broken */
+int sc_loaddef(const char *path);
+
+/* How long sessions created from now on have for logging in, and for
+ * each command, in ms; 0 means forever.  A command running out of time
+ * is interrupted (see sc_timedout()); the others take the session down */
+void sc_deadlines(unsigned long login_ms, unsigned long cmd_ms);
+
+sc *sc_new(void);
+void sc_destroy(sc *s);
+
+/* have command output parsed into rows, see tbl.h */
+void sc_setrows(sc *s, tbl_row_fn f_row, void *ctx);
+
+/* 0 on success, -1 if we could not connect (see sc_error()) */
+int sc_start(sc *s, const char *host);
+
+/* 1 if progress was made, 0 if we need to wait for sc_getfd() to become
+ * readable, -1 if the session was lost and we're OFFLINE now */
+int sc_operate(sc *s);
+void sc_write(sc *s, const char *str, size_t len);
+
+/* A queued command, and what came of it; see sc_take().  `ps1` is the
+ * prompt it was sent at */
+struct sc_result {
+	const char *cmd, *reply, *ps1;
+	size_t cmdlen, replylen, ps1len;
+	bool timedout; /* see sc_timedout() */
+};
+
+/* Queue the newline-terminated commands in `cmds`, in any state but
+ * OFFLINE.  Each is sent as soon as the previous one's prompt shows up,
+ * without waiting for anyone to collect the replies; sc_take() does
+ * that.  We're not ready until they're all done */
+void sc_queue(sc *s, const char *cmds, size_t len);
+
+/* Number of queued commands not completed yet */
+size_t sc_pending(sc *s);
+
+/* Take the oldest completed command off the queue; false if there's none.
+ * What `*r` points to stays valid until the next call */
+bool sc_take(sc *s, struct sc_result *r);
+
+/* The queued command in flight, with an empty reply; false if there's
+ * none.  When streaming, its reply so far is sc_peekreply()'s, and
+ * sc_take() has what wasn't sc_consume()d of it */
+bool sc_inflight(sc *s, struct sc_result *r);
+
+/* Send the lines in `data` without waiting for each one's echo and
+ * prompt, keeping up to `window` of them unacknowledged.  Stops at the
+ * first line the switch rejects.  The reply is a summary.  -1 if we
+ * don't know how to push at the prompt we're at, 0 otherwise */
+int sc_push(sc *s, const char *data, size_t len, size_t window);
+
+/* Line number of the line the last push stopped at, 0 if none */
+unsigned long sc_pushfailed(sc *s);
+
+/* reply and prompt are views into FSM-owned buffers, valid until the
+ * next sc_write(); their lengths are stored in `*len` */
+bool sc_hasreply(sc *s);
+const char *sc_getreply(sc *s, size_t *len);
+const char *sc_getps1(sc *s, size_t *len);
+
+/* Hand out a command's output while it's still coming, rather than all
+ * of it once we're READY.  Output the caller doesn't sc_consume() piles
+ * up to a limit, beyond which we stop reading from the switch until it
+ * does (sc_paused()).  Only what's final can be handed out early, so
+ * sc_getreply() still has the rest when we're READY */
+void sc_setstreaming(sc *s, bool on);
+
+/* the output of the current command so far that hasn't been
+ * sc_consume()d; empty unless streaming and BUSY with a command */
+const char *sc_peekreply(sc *s, size_t *len);
+void sc_consume(sc *s, size_t len);
+bool sc_paused(sc *s);
+
+bool sc_busy(sc *s);
+bool sc_offline(sc *s);
+bool sc_ready(sc *s);
+
+/* the last command ran out of time and was interrupted; there's no
+ * reply, but we're at the prompt again */
+bool sc_timedout(sc *s);
+
+/* ms until sc_operate() needs to be called even if sc_getfd() doesn't
+ * become readable, -1 if there's no such deadline */
+long sc_timeout(sc *s);
+
+/* why we're OFFLINE, NULL if we aren't */
+const char *sc_error(sc *s);
+
+/* if sc_operate() returned 0 and this isn't 0, don't wait for
+ * sc_getfd() but this many ms */
+unsigned long sc_holdoff(sc *s);
+int sc_getfd(sc *s);
 
 #endif
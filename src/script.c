@@ -0,0 +1,394 @@
+/* script.c - Scripted interaction with a switch, for fleet
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_SCRIPT
+
+#include "script.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/acm.h"
+#include "common/common.h"
+#include "common/log.h"
+
+#define LINESZ 1024
+#define MAXWORDS 8
+#define NAMESZ 32
+#define ERRSZ 256
+
+/* statements a script may run through without sending anything; more
+ * and it's going around in circles */
+#define MAXSTEPS 1024
+
+#define OP_SEND 0
+#define OP_EXPECT 1
+#define OP_REJECT 2
+#define OP_PROMPT 3
+#define OP_ON 4
+#define OP_GOTO 5
+#define OP_FAIL 6
+#define OP_DONE 7
+
+
+struct stmt {
+	int op;
+	char *str;   /* OP_SEND (with the newline), OP_PROMPT, OP_FAIL */
+	size_t len;
+	size_t pat;  /* OP_EXPECT, OP_REJECT, OP_ON: in script.pats */
+	char label[NAMESZ]; /* OP_ON, OP_GOTO, until resolved into `to` */
+	size_t to;
+	unsigned long lineno;
+};
+
+struct label {
+	char name[NAMESZ];
+	size_t at;
+};
+
+struct script {
+	char path[256];
+	struct stmt *stmts;
+	size_t nstmts, stmtssz;
+
+	/* the strings output is checked for, each once, all of them in one
+	 * pass by `acm` (the ids it has for them are indices here) */
+	acm *acm;
+	char **pats;
+	size_t *patlens;
+	size_t npats, patssz;
+};
+
+struct scriptrun {
+	const struct script *sp;
+	size_t pc;   /* next statement */
+	bool sent;   /* waiting for stmts[pc-1]'s command */
+
+	/* which of sp->pats the last command's output had so far, and
+	 * where sp->acm is at, for those straddling what we're fed at a time */
+	bool *seen;
+	size_t state;
+
+	bool failed;
+	char error[ERRSZ];
+};
+
+
+static void statement(struct script *sp, char **w, bool *quoted, size_t nw,
+                      struct label **labels, size_t *nlabels,
+                      unsigned long ln);
+static void resolve(struct script *sp, struct label *labels,
+                    size_t nlabels);
+static size_t addpat(struct script *sp, const char *pat, unsigned long ln);
+static void seen(void *ctx, size_t id, size_t end);
+static int fail(scriptrun *r, const char *fmt, ...);
+
+
+script *
+script_load(const char *path)
+{
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		CE("cannot open script '%s'", path);
+
+	struct script *sp = xmalloc(sizeof *sp);
+	memset(sp, 0, sizeof *sp);
+	sp->acm = acm_new();
+	snprintf(sp->path, sizeof sp->path, "%s", path);
+
+	struct label *labels = NULL;
+	size_t nlabels = 0;
+
+	char line[LINESZ];
+	char *w[MAXWORDS];
+	bool quoted[MAXWORDS];
+	unsigned long ln = 0;
+	while (fgets(line, sizeof line, fp)) {
+		ln++;
+		if (!strchr(line, '\n') && !feof(fp))
+			C("%s:%lu: line too long", path, ln);
+
+		size_t nw;
+		char err[128];
+		if (!splitwords(line, w, quoted, MAXWORDS, &nw, err, sizeof err))
+			C("%s:%lu: %s", path, ln, err);
+		if (nw)
+			statement(sp, w, quoted, nw, &labels, &nlabels, ln);
+	}
+
+	if (ferror(fp))
+		CE("reading '%s'", path);
+	fclose(fp);
+
+	resolve(sp, labels, nlabels);
+	free(labels);
+	acm_compile(sp->acm);
+
+	N("loaded script '%s' (%zu statements, %zu patterns)", path,
+	  sp->nstmts, sp->npats);
+	return sp;
+}
+
+void
+script_destroy(script *sp)
+{
+	if (!sp)
+		return;
+
+	for (size_t i = 0; i < sp->nstmts; i++)
+		free(sp->stmts[i].str);
+	for (size_t i = 0; i < sp->npats; i++)
+		free(sp->pats[i]);
+	free(sp->stmts);
+	free(sp->pats);
+	free(sp->patlens);
+	acm_destroy(sp->acm);
+	free(sp);
+	return;
+}
+
+scriptrun *
+scriptrun_new(const script *sp)
+{
+	scriptrun *r = xmalloc(sizeof *r);
+	r->sp = sp;
+	r->pc = 0;
+	r->sent = false;
+	r->seen = xmalloc((sp->npats ? sp->npats : 1) * sizeof *r->seen);
+	r->state = 0;
+	r->failed = false;
+	r->error[0] = '\0';
+	return r;
+}
+
+void
+scriptrun_destroy(scriptrun *r)
+{
+	if (!r)
+		return;
+
+	free(r->seen);
+	free(r);
+	return;
+}
+
+void
+scriptrun_feed(scriptrun *r, const char *data, size_t len)
+{
+	const struct script *sp = r->sp;
+	if (sp->npats)
+		r->state = acm_scan(sp->acm, r->state, data, len, seen, r);
+
+	return;
+}
+
+int
+scriptrun_resume(scriptrun *r, sc *s)
+{
+	const struct script *sp = r->sp;
+	if (r->failed)
+		return SCRIPT_FAILED;
+
+	if (r->sent) {
+		r->sent = false;
+		if (sc_timedout(s))
+			return fail(r, "'%.*s' timed out",
+			            (int)sp->stmts[r->pc-1].len - 1,
+			            sp->stmts[r->pc-1].str);
+	}
+
+	size_t ps1len;
+	const char *ps1 = sc_getps1(s, &ps1len);
+	for (size_t n = 0; n < MAXSTEPS; n++) {
+		if (r->pc == sp->nstmts)
+			return SCRIPT_DONE;
+
+		const struct stmt *st = &sp->stmts[r->pc++];
+		switch (st->op) {
+		case OP_SEND:
+			D("sending '%.*s'", (int)st->len - 1, st->str);
+			memset(r->seen, 0, sp->npats * sizeof *r->seen);
+			r->state = 0;
+			sc_queue(s, st->str, st->len);
+			r->sent = true;
+			return SCRIPT_RUNNING;
+		case OP_EXPECT:
+			if (!r->seen[st->pat])
+				return fail(r, "%s:%lu: no '%s' in the output",
+				            sp->path, st->lineno, sp->pats[st->pat]);
+			break;
+		case OP_REJECT:
+			if (r->seen[st->pat])
+				return fail(r, "%s:%lu: '%s' in the output",
+				            sp->path, st->lineno, sp->pats[st->pat]);
+			break;
+		case OP_PROMPT:
+			if (!hasstr(ps1, ps1len, st->str, st->len))
+				return fail(r, "%s:%lu: at prompt '%.*s'", sp->path,
+				            st->lineno, (int)ps1len, ps1);
+			break;
+		case OP_ON:
+			if (r->seen[st->pat] || hasstr(ps1, ps1len,
+			    sp->pats[st->pat], sp->patlens[st->pat]))
+				r->pc = st->to;
+			break;
+		case OP_GOTO:
+			r->pc = st->to;
+			break;
+		case OP_FAIL:
+			return fail(r, "%s", st->str);
+		case OP_DONE:
+			r->pc = sp->nstmts;
+			return SCRIPT_DONE;
+		}
+	}
+
+	return fail(r, "%s: going around in circles", sp->path);
+}
+
+const char *
+scriptrun_error(scriptrun *r)
+{
+	return r->failed ? r->error : NULL;
+}
+
+
+
+static void
+statement(struct script *sp, char **w, bool *quoted, size_t nw,
+          struct label **labels, size_t *nlabels, unsigned long ln)
+{
+	const char *kw = w[0];
+	if (strcmp(kw, "label") == 0 && nw == 2) {
+		for (size_t i = 0; i < *nlabels; i++)
+			if (strcmp((*labels)[i].name, w[1]) == 0)
+				C("%s:%lu: label '%s' again", sp->path, ln, w[1]);
+
+		*labels = xrealloc(*labels, (*nlabels + 1) * sizeof **labels);
+		struct label *l = &(*labels)[(*nlabels)++];
+		snprintf(l->name, sizeof l->name, "%s", w[1]);
+		l->at = sp->nstmts;
+		return;
+	}
+
+	if (sp->nstmts == sp->stmtssz)
+		sp->stmts = xrealloc(sp->stmts, (sp->stmtssz = sp->stmtssz
+		                     ? sp->stmtssz * 2 : 16) * sizeof *sp->stmts);
+
+	struct stmt *st = &sp->stmts[sp->nstmts];
+	memset(st, 0, sizeof *st);
+	st->lineno = ln;
+
+	if (strcmp(kw, "send") == 0 && nw == 2 && quoted[1]) {
+		if (strchr(w[1], '\n'))
+			C("%s:%lu: one line per send", sp->path, ln);
+		st->op = OP_SEND;
+		st->len = strlen(w[1]) + 1;
+		st->str = xmalloc(st->len + 1);
+		memcpy(st->str, w[1], st->len - 1);
+		strcpy(st->str + st->len - 1, "\n");
+	} else if (strcmp(kw, "expect") == 0 && nw == 2 && quoted[1]) {
+		st->op = OP_EXPECT;
+		st->pat = addpat(sp, w[1], ln);
+	} else if (strcmp(kw, "reject") == 0 && nw == 2 && quoted[1]) {
+		st->op = OP_REJECT;
+		st->pat = addpat(sp, w[1], ln);
+	} else if (strcmp(kw, "prompt") == 0 && nw == 2 && quoted[1]) {
+		st->op = OP_PROMPT;
+		st->str = xstrdup(w[1]);
+		st->len = strlen(w[1]);
+	} else if (strcmp(kw, "on") == 0 && nw == 3 && quoted[1]) {
+		st->op = OP_ON;
+		st->pat = addpat(sp, w[1], ln);
+		snprintf(st->label, sizeof st->label, "%s", w[2]);
+	} else if (strcmp(kw, "goto") == 0 && nw == 2) {
+		st->op = OP_GOTO;
+		snprintf(st->label, sizeof st->label, "%s", w[1]);
+	} else if (strcmp(kw, "fail") == 0 && nw == 2 && quoted[1]) {
+		st->op = OP_FAIL;
+		st->str = xstrdup(w[1]);
+	} else if (strcmp(kw, "done") == 0 && nw == 1) {
+		st->op = OP_DONE;
+	} else
+		C("%s:%lu: bad statement '%s'", sp->path, ln, kw);
+
+	sp->nstmts++;
+	return;
+}
+
+/* turn the labels jumped to into statement indices */
+static void
+resolve(struct script *sp, struct label *labels, size_t nlabels)
+{
+	for (size_t i = 0; i < sp->nstmts; i++) {
+		struct stmt *st = &sp->stmts[i];
+		if (st->op != OP_ON && st->op != OP_GOTO)
+			continue;
+
+		size_t l = 0;
+		while (l < nlabels && strcmp(labels[l].name, st->label) != 0)
+			l++;
+		if (l == nlabels)
+			C("%s:%lu: no label '%s'", sp->path, st->lineno,
+			  st->label);
+		st->to = labels[l].at;
+	}
+
+	return;
+}
+
+static size_t
+addpat(struct script *sp, const char *pat, unsigned long ln)
+{
+	size_t len = strlen(pat);
+	if (!len)
+		C("%s:%lu: empty pattern", sp->path, ln);
+
+	size_t id = acm_add(sp->acm, pat, len);
+	if (id < sp->npats)
+		return id;
+
+	if (sp->npats == sp->patssz) {
+		sp->patssz = sp->patssz ? sp->patssz * 2 : 8;
+		sp->pats = xrealloc(sp->pats, sp->patssz * sizeof *sp->pats);
+		sp->patlens = xrealloc(sp->patlens,
+		                       sp->patssz * sizeof *sp->patlens);
+	}
+
+	sp->pats[sp->npats] = xstrdup(pat);
+	sp->patlens[sp->npats] = len;
+	return sp->npats++;
+}
+
+/* sp->acm found pattern `id` in the output */
+static void
+seen(void *ctx, size_t id, size_t end)
+{
+	(void)end;
+	scriptrun *r = ctx;
+	r->seen[id] = true;
+	return;
+}
+
+/* the script failed; remember why.  returns SCRIPT_FAILED so it can
+ * double as the return value of whatever noticed */
+static int
+fail(scriptrun *r, const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vsnprintf(r->error, sizeof r->error, fmt, ap);
+	va_end(ap);
+
+	D("script failed: %s", r->error);
+	r->failed = true;
+	return SCRIPT_FAILED;
+}
@@ -0,0 +1,60 @@
+/* script.h - Scripted interaction with a switch, for fleet
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <stddef.h>
+
+#include "sc.h"
+
+/* A script is a list of statements, one per line, in the syntax of the
+ * def backend's definitions (see back/def/def.h).  E.g.:
+ *
+ *   send    "configure"          # run a command, wait for its prompt
+ *   prompt  "(config)#"          # give up unless we're at this prompt
+ *   send    "write memory"
+ *   reject  "Invalid input"      # give up if the output had this
+ *   on      "[y/n]" confirm      # go to `confirm` if output or prompt
+ *   done                         #   has this, otherwise we're done
+ *   label   confirm
+ *   send    "y"
+ *   expect  "saved"              # give up unless the output had this
+ *   fail    "not saved"          # give up, saying so
+ *   goto    confirm              # go on at `confirm`
+ *
+ * expect, reject and on look at the last command's output, seen as it
+ * streams by, so they work on replies of any size.  A command running
+ * out of time fails the script.
+ *
+ * A script doesn't have a thread or stack of its own.  It runs until it
+ * sends a command, then picks up where it left off once that command is
+ * done.  So any number of them can run side by side on the sessions of
+ * one poll() loop */
+
+#define SCRIPT_RUNNING 0 /* sent a command, resume when we're READY */
+#define SCRIPT_DONE 1
+#define SCRIPT_FAILED -1 /* see scriptrun_error() */
+
+typedef struct script script;
+typedef struct scriptrun scriptrun;
+
+/* Read and check the script in `path`, panics on error */
+script *script_load(const char *path);
+void script_destroy(script *sp);
+
+/* One session's way through `sp`, from the top */
+scriptrun *scriptrun_new(const script *sp);
+void scriptrun_destroy(scriptrun *r);
+
+/* The output of the command we sent, as it comes */
+void scriptrun_feed(scriptrun *r, const char *data, size_t len);
+
+/* `s` is READY; go on until the script sent a command or is over */
+int scriptrun_resume(scriptrun *r, sc *s);
+
+/* why it failed, NULL if it didn't */
+const char *scriptrun_error(scriptrun *r);
+
+#endif
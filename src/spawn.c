@@ -10,31 +10,81 @@
 
 #include "spawn.h"
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 #include "common/log.h"
+#include "common/common.h"
 
+/* a master that exits sooner than this after being started likely
+ * can't be had (auth, MaxSessions, ...); sessions to its switch go
+ * without one for a while */
+#define MASTER_MINLIFE_MS 5000
+#define MASTER_RETRY_MS 60000
 
-/* these are ssh's. [0] is read end, [1] is write end */
-static int s_stdin[2];
-static int s_stdout[2];
-static int s_stderr[2];
 
-static char s_host[256];
-static pid_t s_childpid;
+/* An ssh -M we keep per switch when multiplexing, so that sessions are
+ * just channels on its connection rather than connections of their own */
+struct master {
+	char host[256];
+	char path[280];       /* its ControlPath */
+	pid_t pid;            /* -1 if not running */
+	uint64_t started;
+	uint64_t retryafter;  /* don't start it again before this */
+	unsigned users;       /* sessions to this switch that are alive */
+	uint64_t idlesince;   /* when the last of them went away */
+};
 
-static bool s_sigchld;
+/* a session we spawned, and which master's switch it talks to (when
+ * multiplexing) */
+struct session {
+	pid_t pid;
+	size_t master;
+};
+
+
+static volatile sig_atomic_t s_sigchld;
+
+/* fleet's workers launch and reap concurrently; this covers the
+ * masters and sessions below */
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static char **s_env;
 
+/* whether to multiplex, and how long to keep an unused master around,
+ * in ms (0: until we exit) */
+static bool s_mux;
+static unsigned long s_persist;
+
+/* our ControlPath directory, mode 0700 */
+static char s_ctldir[256];
+
+static struct master *s_masters;
+static size_t s_nmasters;
+
+static struct session *s_sessions;
+static size_t s_nsessions, s_sessionssz;
+
 
-static void dowait(void);
+static pid_t launch(const char *host, int *stin, int *stout, int *sterr);
+static void closepipes(int p[3][2]);
 static void sigchld(int s);
+static size_t getmaster(const char *host);
+static void startmaster(struct master *m);
+static void reap(pid_t pid);
+static void reaped(pid_t pid, int st);
+static void expire(void);
+static void cleanup(void);
 
 
 void
@@ -42,107 +92,340 @@ spawn_init(char **envp)
 {
 	s_env = envp;
 	signal(SIGCHLD, sigchld);
+
+	/* a switch hanging up on us shouldn't kill us when we write to it */
+	signal(SIGPIPE, SIG_IGN);
 	I("spawn initialized");
 	return;
 }
 
+void
+spawn_multiplex(unsigned long persist_s)
+{
+	/* mkdir() fails rather than reuse something that's there already */
+	const char *tmp = getenv("TMPDIR");
+	snprintf(s_ctldir, sizeof s_ctldir, "%s/swh.%ld.%llu",
+	         tmp && *tmp ? tmp : "/tmp", (long)getpid(),
+	         (unsigned long long)timestamp_ms());
+	if (mkdir(s_ctldir, 0700) != 0)
+		CE("mkdir %s", s_ctldir);
+
+	s_mux = true;
+	s_persist = persist_s * 1000;
+	atexit(cleanup);
+	I("multiplexing sessions, control sockets in %s", s_ctldir);
+	return;
+}
+
+/* reap whatever children of ours have died, let go of masters nobody
+ * uses.  Only ours: a program embedding us may have others, and their
+ * exit statuses are its business */
 void
 spawn_operate(void)
 {
+	pthread_mutex_lock(&s_lock);
+	if (s_mux)
+		expire();
+
 	if (s_sigchld) {
 		I("SIGCHLD seen");
 		s_sigchld = false;
-		dowait();
+
+		for (size_t i = 0; i < s_nmasters; i++)
+			reap(s_masters[i].pid);
+
+		/* backwards, reaped() moves the last one into the gap */
+		for (size_t i = s_nsessions; i-- > 0;)
+			reap(s_sessions[i].pid);
 	}
+
+	pthread_mutex_unlock(&s_lock);
 	return;
 }
 
-int
+/* launch ssh to `host`; its stdin, stdout and stderr are stored in `*stin`,
+ * `*stout` and `*sterr`.  returns the pid, or -1 on failure */
+pid_t
 spawn_launch(const char *host, int *stin, int *stout, int *sterr)
+{
+	/* all our forks happen under the lock, so no child ever sees
+	 * another one's pipes before they're FD_CLOEXEC */
+	pthread_mutex_lock(&s_lock);
+	pid_t r = launch(host, stin, stout, sterr);
+	pthread_mutex_unlock(&s_lock);
+	return r;
+}
+
+/* we're done with the ssh at `pid`; it is reaped by spawn_operate() */
+void
+spawn_kill(pid_t pid)
+{
+	D("killing ssh, pid %d", (int)pid);
+	if (kill(pid, SIGTERM) != 0 && errno != ESRCH)
+		EE("kill %d", (int)pid);
+	return;
+}
+
+
+
+static pid_t
+launch(const char *host, int *stin, int *stout, int *sterr)
 {
 	D("spawn called for host '%s'", host);
-	if (pipe(s_stdin) != 0) {
-		EE("pipe in");
-		return -1;
-	}
-	if (pipe(s_stdout) != 0) {
-		EE("pipe out");
-		return -1;
-	}
-	if (pipe(s_stderr) != 0) {
-		EE("pipe err");
-		return -1;
+
+	/* with a master, ssh makes this a channel on its connection; if
+	 * its socket isn't there (yet), ssh connects on its own.  It's
+	 * started before our pipes exist, so it can't inherit them */
+	size_t m = 0;
+	char ctlarg[300] = "ControlPath=none";
+	if (s_mux) {
+		m = getmaster(host);
+		if (s_masters[m].pid == -1
+		    && timestamp_ms() >= s_masters[m].retryafter)
+			startmaster(&s_masters[m]);
+		if (s_masters[m].pid != -1)
+			snprintf(ctlarg, sizeof ctlarg, "ControlPath=%s",
+			         s_masters[m].path);
 	}
 
-	snprintf(s_host, sizeof s_host, "%s", host);
+	/* ssh's stdin, stdout, stderr.  [0] is read end, [1] is write end */
+	int p[3][2] = { { -1, -1 }, { -1, -1 }, { -1, -1 } };
+	for (size_t i = 0; i < 3; i++)
+		if (pipe(p[i]) != 0) {
+			EE("pipe");
+			closepipes(p);
+			return -1;
+		}
+
+	char hostarg[256];
+	snprintf(hostarg, sizeof hostarg, "%s", host);
+
 	I("forking");
 
-	int r = fork();
+	pid_t r = fork();
 	if (r == -1) {
 		EE("fork");
+		closepipes(p);
 		return -1;
 	} else if (r == 0) {
-		close(s_stdin[1]); close(s_stdout[0]); close(s_stderr[0]);
+		close(p[0][1]); close(p[1][0]); close(p[2][0]);
 		close(0); close(1); close(2);
 
-		dup2(s_stdin[0], 0);
-		dup2(s_stdout[1], 1);
-		dup2(s_stderr[1], 2);
+		dup2(p[0][0], 0);
+		dup2(p[1][1], 1);
+		dup2(p[2][1], 2);
 
 		char binary[] = "/usr/bin/ssh";
 		char arg[] = "-T";
-		char *argv[] = { binary, arg, s_host, NULL };
+		char opt[] = "-o";
+		char nomaster[] = "ControlMaster=no";
+		char *argv[8];
+		size_t n = 0;
+		argv[n++] = binary;
+		argv[n++] = arg;
+		if (s_mux) {
+			argv[n++] = opt; argv[n++] = nomaster;
+			argv[n++] = opt; argv[n++] = ctlarg;
+		}
+		argv[n++] = hostarg;
+		argv[n] = NULL;
 		int e = execve(binary, argv, s_env);
 		fprintf(stderr, "child: execve: %d\n", e);
 		_exit(1);
-	} else {
-		close(s_stdin[0]); close(s_stdout[1]); close(s_stderr[1]);
+	}
 
-		*stin = s_stdin[1];
-		*stout = s_stdout[0];
-		*sterr = s_stderr[0];
+	close(p[0][0]); close(p[1][1]); close(p[2][1]);
 
-		s_childpid = r;
-		I("ssh spawned, pid %d", (int)s_childpid);
-		return 0;
+	/* don't let our other children inherit these, or they'd keep
+	 * this ssh's stdin open */
+	*stin = p[0][1];
+	*stout = p[1][0];
+	*sterr = p[2][0];
+	fcntl(*stin, F_SETFD, FD_CLOEXEC);
+	fcntl(*stout, F_SETFD, FD_CLOEXEC);
+	fcntl(*sterr, F_SETFD, FD_CLOEXEC);
+
+	if (s_nsessions == s_sessionssz)
+		s_sessions = xrealloc(s_sessions, (s_sessionssz =
+		    s_sessionssz ? s_sessionssz * 2 : 16) * sizeof *s_sessions);
+	s_sessions[s_nsessions++] = (struct session){ r, m };
+	if (s_mux)
+		s_masters[m].users++;
+
+	I("ssh spawned, pid %d", (int)r);
+	return r;
+}
+
+static void
+closepipes(int p[3][2])
+{
+	for (size_t i = 0; i < 3; i++)
+		for (size_t j = 0; j < 2; j++)
+			if (p[i][j] >= 0)
+				close(p[i][j]);
+	return;
+}
+
+static void
+sigchld(int s)
+{
+	(void)s;
+	s_sigchld = true;
+}
+
+/* the master slot for `host`, made if there isn't one yet */
+static size_t
+getmaster(const char *host)
+{
+	for (size_t i = 0; i < s_nmasters; i++)
+		if (strcmp(s_masters[i].host, host) == 0)
+			return i;
+
+	s_masters = xrealloc(s_masters, (s_nmasters + 1) * sizeof *s_masters);
+	struct master *m = &s_masters[s_nmasters];
+	memset(m, 0, sizeof *m);
+	snprintf(m->host, sizeof m->host, "%s", host);
+	snprintf(m->path, sizeof m->path, "%s/%zu", s_ctldir, s_nmasters);
+	m->pid = -1;
+	return s_nmasters++;
+}
+
+/* launch `ssh -MN` for `m`; it is reaped by spawn_operate() like the
+ * sessions are */
+static void
+startmaster(struct master *m)
+{
+	char hostarg[256];
+	snprintf(hostarg, sizeof hostarg, "%s", m->host);
+	char ctlarg[300];
+	snprintf(ctlarg, sizeof ctlarg, "ControlPath=%s", m->path);
+
+	pid_t r = fork();
+	if (r == -1) {
+		EE("fork");
+		return;
+	} else if (r == 0) {
+		int fd = open("/dev/null", O_RDWR);
+		if (fd != -1) {
+			dup2(fd, 0);
+			dup2(fd, 1);
+			dup2(fd, 2);
+		}
+
+		char binary[] = "/usr/bin/ssh";
+		char arg[] = "-MNT";
+		char opt[] = "-o";
+		char persist[] = "ControlPersist=no";
+		char *argv[] = { binary, arg, opt, persist, opt, ctlarg,
+		                 hostarg, NULL };
+		execve(binary, argv, s_env);
+		_exit(1);
 	}
+
+	m->pid = r;
+	m->started = timestamp_ms();
+	m->idlesince = m->started;
+	I("ssh master for '%s' spawned, pid %d", m->host, (int)r);
+	return;
 }
 
-void
-spawn_kill(void)
+/* reap `pid` (one of s_masters or s_sessions; -1: none) if it's dead */
+static void
+reap(pid_t pid)
 {
-	if (!s_childpid)
+	if (pid == -1)
+		return;
+
+	int st;
+	pid_t p = waitpid(pid, &st, WNOHANG);
+	if (p == 0)
 		return;
-	D("closing our pipe to ssh's stdin");
-	close(s_stdin[1]);
-	s_stdin[1] = -1;
+
+	if (p == -1) {
+		/* somebody else reaped it; it's gone all the same */
+		if (errno != ECHILD) {
+			EE("waitpid %d", (int)pid);
+			return;
+		}
+		st = 0;
+	}
+
+	I("child %d ded, ec %d", (int)pid, (int)WEXITSTATUS(st));
+	reaped(pid, st);
 	return;
 }
 
+/* child `pid` is gone; forget it.  If it was a session, its master has
+ * one user less */
+static void
+reaped(pid_t pid, int st)
+{
+	for (size_t i = 0; i < s_nmasters; i++) {
+		struct master *m = &s_masters[i];
+		if (m->pid != pid)
+			continue;
+
+		m->pid = -1;
+		unlink(m->path);
+		if (timestamp_ms() - m->started < MASTER_MINLIFE_MS) {
+			W("ssh master for '%s' quit right away (ec %d), going "
+			  "without for %d secs", m->host, (int)WEXITSTATUS(st),
+			  MASTER_RETRY_MS / 1000);
+			m->retryafter = timestamp_ms() + MASTER_RETRY_MS;
+		} else
+			N("ssh master for '%s' quit (ec %d)", m->host,
+			  (int)WEXITSTATUS(st));
+		return;
+	}
+
+	for (size_t i = 0; i < s_nsessions; i++) {
+		if (s_sessions[i].pid != pid)
+			continue;
+
+		if (s_mux) {
+			struct master *m = &s_masters[s_sessions[i].master];
+			if (--m->users == 0)
+				m->idlesince = timestamp_ms();
+		}
+		s_sessions[i] = s_sessions[--s_nsessions];
+		return;
+	}
 
+	return;
+}
 
+/* stop masters that have been unused for longer than s_persist */
 static void
-dowait(void)
+expire(void)
 {
-	int st = -1;
-	D("waiting for child");
-	pid_t p = wait(&st);
-	if (p != s_childpid)
-		C("waited for %d but got %d (with exit status %d)",
-		    (int)s_childpid, (int)p, WEXITSTATUS(st));
-	I("child %d ded, ec %d", (int)s_childpid, (int)WEXITSTATUS(st));
-	s_childpid = 0;
-	close(s_stdout[0]);
-	close(s_stderr[0]);
-	if (s_stdin[1] >= 0)
-		close(s_stdin[1]);
+	if (!s_persist)
+		return;
+
+	uint64_t now = timestamp_ms();
+	for (size_t i = 0; i < s_nmasters; i++) {
+		struct master *m = &s_masters[i];
+		if (m->pid == -1 || m->users || now - m->idlesince < s_persist)
+			continue;
+
+		D("ssh master for '%s' unused, stopping it", m->host);
+		spawn_kill(m->pid);
+		m->idlesince = now; // it's reaped later; don't kill it twice
+	}
 
 	return;
 }
 
+/* at exit, take our masters and their sockets with us */
 static void
-sigchld(int s)
+cleanup(void)
 {
-	(void)s;
-	s_sigchld = true;
+	for (size_t i = 0; i < s_nmasters; i++) {
+		if (s_masters[i].pid != -1)
+			kill(s_masters[i].pid, SIGTERM);
+		unlink(s_masters[i].path);
+	}
+
+	if (rmdir(s_ctldir) != 0)
+		WE("rmdir %s", s_ctldir);
+	return;
 }
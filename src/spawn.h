@@ -5,9 +5,17 @@
 #ifndef SPAWN_H
 #define SPAWN_H
 
+#include <sys/types.h>
+
 void spawn_init(char **envp);
+
+/* From now on, keep an ssh master connection per switch and make
+ * sessions channels on it (ssh's ControlMaster).  Masters nobody uses
+ * are stopped after `persist_s` seconds (0: when we exit) */
+void spawn_multiplex(unsigned long persist_s);
+
 void spawn_operate(void);
-int spawn_launch(const char *host, int *stin, int *stout, int *sterr);
-void spawn_kill(void);
+pid_t spawn_launch(const char *host, int *stin, int *stout, int *sterr);
+void spawn_kill(pid_t pid);
 
 #endif
@@ -0,0 +1,364 @@
+/* tbl.c - Streaming parser for tabular command output; handled by sc
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_TBL
+
+#include "tbl.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common/common.h"
+#include "common/log.h"
+
+#define MAXCOLS 32
+#define MAXHDR 2     /* header lines above the separator we consider */
+#define NAMESZ 48
+#define LINEBUFSZ 256
+#define MAXCMDLEN 512
+
+
+/* Commands whose output we know to be tabular, and what we call the
+ * tables.  These are laid out like
+ *
+ *   VLAN ID Name                             | Status     Voice Jumbo
+ *   ------- -------------------------------- + ---------- ----- -----
+ *   1       DEFAULT_VLAN                     | Port-based No    No
+ *
+ * i.e. the dashes tell where the columns are, the line(s) directly above
+ * them name the columns, and rows follow until a blank line. */
+static const struct tbldef {
+	const char *cmd;
+	const char *name;
+} s_defs[] = {
+	{ "show vlans",                   "vlans" },
+	{ "show interfaces brief",        "interfaces_brief" },
+	{ "show mac-address-table",       "mac_address_table" },
+	{ "show lldp info remote-device", "lldp_remote_device" },
+};
+
+struct tbl {
+	tbl_row_fn f_row;
+	void *ctx;
+	const struct tbldef *cur; /* NULL if we're not parsing */
+
+	char *line; /* the line we're currently receiving */
+	size_t linesz, linecnt;
+
+	/* the most recent non-blank lines, candidates for the column header */
+	char *hdr[MAXHDR];
+	size_t hdrsz[MAXHDR];
+	size_t nhdr;
+
+	/* column layout, once we've seen the separator.  column i spans from
+	 * start[i] up to start[i+1], the last one to the end of the line */
+	bool intbl;
+	size_t ncols;
+	size_t start[MAXCOLS];
+	char names[MAXCOLS][NAMESZ];
+	const char *nameptrs[MAXCOLS];
+	bool first;
+	size_t nrows;
+
+	char *vals; /* a row's values, each NUL-terminated */
+	size_t valssz;
+};
+
+
+static void line(tbl *t, char *ln, size_t len);
+static bool isseparator(const char *ln, size_t len);
+static void columns(tbl *t, const char *sep, size_t len);
+static void mkname(char *dest, size_t destsz, const char *text);
+static void row(tbl *t, const char *ln, size_t len);
+static size_t span(tbl *t, const char *ln, size_t len, size_t col,
+                   size_t *from);
+
+
+tbl *
+tbl_new(tbl_row_fn f_row, void *ctx)
+{
+	tbl *t = xmalloc(sizeof *t);
+	t->f_row = f_row;
+	t->ctx = ctx;
+	t->cur = NULL;
+	(t->line = xmalloc(t->linesz = LINEBUFSZ))[0] = '\0';
+	(t->vals = xmalloc(t->valssz = LINEBUFSZ))[0] = '\0';
+	for (size_t i = 0; i < MAXHDR; i++)
+		(t->hdr[i] = xmalloc(t->hdrsz[i] = LINEBUFSZ))[0] = '\0';
+	for (size_t i = 0; i < MAXCOLS; i++)
+		t->nameptrs[i] = t->names[i];
+	return t;
+}
+
+void
+tbl_destroy(tbl *t)
+{
+	if (!t)
+		return;
+
+	free(t->line);
+	free(t->vals);
+	for (size_t i = 0; i < MAXHDR; i++)
+		free(t->hdr[i]);
+	free(t);
+	return;
+}
+
+void
+tbl_begin(tbl *t, const char *cmd, size_t cmdlen)
+{
+	t->cur = NULL;
+	t->linecnt = 0;
+	t->nhdr = 0;
+	t->intbl = false;
+	t->nrows = 0;
+
+	if (!t->f_row)
+		return;
+
+	char ncmd[MAXCMDLEN];
+	if (!normcmd(ncmd, sizeof ncmd, cmd, cmdlen))
+		return;
+
+	for (size_t i = 0; i < COUNTOF(s_defs); i++)
+		if (cmdprefix(s_defs[i].cmd, strlen(s_defs[i].cmd), ncmd)) {
+			t->cur = &s_defs[i];
+			D("parsing output of '%s' as '%s'", ncmd, t->cur->name);
+			break;
+		}
+
+	return;
+}
+
+void
+tbl_feed(tbl *t, const char *data, size_t len)
+{
+	if (!t->cur)
+		return;
+
+	const char *end = data + len;
+	while (data < end) {
+		const char *nl = memchr(data, '\n', end - data);
+		size_t n = (nl ? nl : end) - data;
+
+		growbuf(&t->line, &t->linesz, t->linecnt + n + 1);
+		memcpy(t->line + t->linecnt, data, n);
+		t->linecnt += n;
+		t->line[t->linecnt] = '\0';
+
+		if (!nl)
+			break;
+
+		line(t, t->line, t->linecnt);
+		t->linecnt = 0;
+		data = nl + 1;
+	}
+
+	return;
+}
+
+void
+tbl_end(tbl *t)
+{
+	if (!t->cur)
+		return;
+
+	if (t->linecnt)
+		line(t, t->line, t->linecnt);
+
+	D("'%s': %zu rows", t->cur->name, t->nrows);
+	t->cur = NULL;
+	t->linecnt = 0;
+	return;
+}
+
+
+
+static void
+line(tbl *t, char *ln, size_t len)
+{
+	while (len && ln[len-1] == ' ')
+		ln[--len] = '\0';
+
+	size_t i = 0;
+	while (i < len && ln[i] == ' ')
+		i++;
+
+	if (i == len) {
+		/* blank lines end tables, and separate them from headers */
+		t->intbl = false;
+		t->nhdr = 0;
+		return;
+	}
+
+	if (t->intbl) {
+		row(t, ln, len);
+		return;
+	}
+
+	if (t->nhdr && isseparator(ln, len)) {
+		columns(t, ln, len);
+		t->intbl = true;
+		t->first = true;
+		return;
+	}
+
+	/* remember as a potential header line, dropping the oldest */
+	if (t->nhdr == MAXHDR) {
+		char *p = t->hdr[0];
+		size_t sz = t->hdrsz[0];
+		for (size_t j = 1; j < MAXHDR; j++) {
+			t->hdr[j-1] = t->hdr[j];
+			t->hdrsz[j-1] = t->hdrsz[j];
+		}
+		t->hdr[MAXHDR-1] = p;
+		t->hdrsz[MAXHDR-1] = sz;
+		t->nhdr--;
+	}
+
+	growbuf(&t->hdr[t->nhdr], &t->hdrsz[t->nhdr], len + 1);
+	memcpy(t->hdr[t->nhdr], ln, len + 1);
+	t->nhdr++;
+	return;
+}
+
+/* only dashes, blanks and column separators, and at least some dashes */
+static bool
+isseparator(const char *ln, size_t len)
+{
+	if (!strstr(ln, "--"))
+		return false;
+
+	for (size_t i = 0; i < len; i++)
+		if (!strchr("- +|", ln[i]))
+			return false;
+
+	return true;
+}
+
+/* every run of dashes in `sep` is a column; name them after the header */
+static void
+columns(tbl *t, const char *sep, size_t len)
+{
+	t->ncols = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (sep[i] != '-' || (i && sep[i-1] == '-'))
+			continue;
+
+		if (t->ncols == MAXCOLS) {
+			W("'%s': too many columns, ignoring the rest",
+			  t->cur->name);
+			break;
+		}
+
+		t->start[t->ncols++] = i;
+	}
+
+	for (size_t c = 0; c < t->ncols; c++) {
+		char text[NAMESZ * MAXHDR] = "";
+		size_t n = 0;
+		for (size_t h = 0; h < t->nhdr; h++) {
+			size_t from;
+			size_t tlen = span(t, t->hdr[h], strlen(t->hdr[h]), c,
+			                   &from);
+			if (tlen)
+				n += snprintf(text + n, sizeof text - n, "%s%.*s",
+				              n ? " " : "", (int)tlen,
+				              t->hdr[h] + from);
+			if (n >= sizeof text)
+				n = sizeof text - 1;
+		}
+
+		if (*text)
+			mkname(t->names[c], NAMESZ, text);
+		else
+			snprintf(t->names[c], NAMESZ, "col%zu", c);
+	}
+
+	D("'%s': %zu columns", t->cur->name, t->ncols);
+	t->nhdr = 0;
+	return;
+}
+
+/* "MAC Address" -> "mac_address" */
+static void
+mkname(char *dest, size_t destsz, const char *text)
+{
+	size_t n = 0;
+	bool sep = false;
+	for (; *text && n + 2 < destsz; text++) {
+		if (!isalnum((unsigned char)*text)) {
+			sep = n > 0;
+			continue;
+		}
+
+		if (sep)
+			dest[n++] = '_';
+		dest[n++] = tolower((unsigned char)*text);
+		sep = false;
+	}
+
+	dest[n] = '\0';
+	return;
+}
+
+static void
+row(tbl *t, const char *ln, size_t len)
+{
+	const char *vals[MAXCOLS];
+
+	/* values don't overlap, so they fit in the line plus terminators */
+	growbuf(&t->vals, &t->valssz, len + t->ncols + 1);
+	size_t n = 0;
+	for (size_t c = 0; c < t->ncols; c++) {
+		size_t from;
+		size_t vlen = span(t, ln, len, c, &from);
+		memcpy(t->vals + n, ln + from, vlen);
+		vals[c] = t->vals + n;
+		n += vlen;
+		t->vals[n++] = '\0';
+	}
+
+	struct tblrow r = {
+		.table = t->cur->name,
+		.first = t->first,
+		.ncols = t->ncols,
+		.names = t->nameptrs,
+		.vals = vals,
+	};
+
+	t->f_row(t->ctx, &r);
+	t->first = false;
+	t->nrows++;
+	return;
+}
+
+/* length of the text in column `col` of line `ln`, trimmed of blanks and
+ * column separators; where it starts is stored in `*from` */
+static size_t
+span(tbl *t, const char *ln, size_t len, size_t col, size_t *from)
+{
+	size_t f = t->start[col];
+	size_t e = col + 1 < t->ncols ? t->start[col+1] : len;
+	if (e > len)
+		e = len;
+	if (f >= e) {
+		*from = 0;
+		return 0;
+	}
+
+	while (f < e && strchr(" |", ln[f]))
+		f++;
+	while (e > f && strchr(" |", ln[e-1]))
+		e--;
+
+	*from = f;
+	return e - f;
+}
@@ -0,0 +1,40 @@
+/* tbl.h - Streaming parser for tabular command output; handled by sc
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef TBL_H
+#define TBL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* One row of a parsed table.  Everything pointed to is only valid for
+ * the duration of the tbl_row_fn call */
+struct tblrow {
+	const char *table;        /* kind of table, e.g. "vlans" */
+	bool first;               /* first row since the column header */
+	size_t ncols;
+	const char *const *names; /* column names, e.g. "vlan_id" */
+	const char *const *vals;  /* this row's values, trimmed */
+};
+
+typedef void (*tbl_row_fn)(void *ctx, const struct tblrow *row);
+
+typedef struct tbl tbl;
+
+/* rows are handed to `f_row`, along with `ctx`; NULL disables parsing
+ * altogether */
+tbl *tbl_new(tbl_row_fn f_row, void *ctx);
+void tbl_destroy(tbl *t);
+
+/* a command is about to be sent; if we know what its output looks like,
+ * subsequent tbl_feed()s are parsed into rows */
+void tbl_begin(tbl *t, const char *cmd, size_t cmdlen);
+
+/* rendered command output, in whatever pieces it becomes available */
+void tbl_feed(tbl *t, const char *data, size_t len);
+
+/* the output is complete */
+void tbl_end(tbl *t);
+
+#endif
@@ -0,0 +1,310 @@
+/* reader.c - Reads an fd on a thread of its own; for the transports
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_XPORT_READER
+
+#include "reader.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/log.h"
+
+/* that many buffers of CHUNKSZ may be in flight before the thread stops
+ * reading; must be a power of 2 */
+#define RINGSZ 64
+#define CHUNKSZ (64 * 1024)
+
+
+/* What one read() got.  len 0 means EOF or, if err isn't 0, an error;
+ * it's the last chunk either way */
+struct chunk {
+	size_t len;
+	int err;
+	char data[CHUNKSZ];
+};
+
+/* lock-free, for exactly one thread putting and one getting */
+struct ring {
+	struct chunk *slot[RINGSZ];
+	atomic_size_t head; /* next to get, only the getter moves it */
+	atomic_size_t tail; /* next to put, only the putter moves it */
+};
+
+struct reader {
+	int fd;
+	pthread_t thread;
+	struct ring full; /* read chunks, thread -> user */
+	struct ring free; /* used ones for reuse, user -> thread */
+
+	/* wake-ups: there's data (thread -> user); there's room in `full`
+	 * again (user -> thread); reader_destroy() (user -> thread) */
+	int notify[2];
+	int space[2];
+	int stop[2];
+
+	/* the thread found `full` full and waits for room; whoever gets
+	 * from it next pokes `space` */
+	atomic_bool wantroom;
+
+	struct chunk *cur; /* the user is handing this one out */
+	size_t curoff;
+};
+
+
+static void *produce(void *arg);
+static bool waitfor(reader *r, int fd);
+static bool put(struct ring *q, struct chunk *c);
+static struct chunk *get(struct ring *q);
+static void mkpipe(int p[2]);
+static void poke(int fd);
+static void drain(int fd);
+
+
+reader *
+reader_new(int fd)
+{
+	reader *r = xmalloc(sizeof *r);
+	memset(r, 0, sizeof *r);
+	r->fd = fd;
+	atomic_init(&r->full.head, 0);
+	atomic_init(&r->full.tail, 0);
+	atomic_init(&r->free.head, 0);
+	atomic_init(&r->free.tail, 0);
+	atomic_init(&r->wantroom, false);
+	mkpipe(r->notify);
+	mkpipe(r->space);
+	mkpipe(r->stop);
+
+	int e = pthread_create(&r->thread, NULL, produce, r);
+	if (e) {
+		errno = e;
+		CE("pthread_create");
+	}
+
+	D("reading fd %d on a thread", fd);
+	return r;
+}
+
+void
+reader_destroy(reader *r)
+{
+	if (!r)
+		return;
+
+	poke(r->stop[1]);
+	pthread_join(r->thread, NULL);
+
+	struct chunk *c;
+	while ((c = get(&r->full)))
+		free(c);
+	while ((c = get(&r->free)))
+		free(c);
+	free(r->cur);
+
+	int *fds[] = { r->notify, r->space, r->stop };
+	for (size_t i = 0; i < COUNTOF(fds); i++) {
+		close(fds[i][0]);
+		close(fds[i][1]);
+	}
+	free(r);
+	return;
+}
+
+int
+reader_fd(reader *r)
+{
+	return r->notify[0];
+}
+
+ssize_t
+reader_read(reader *r, void *dest, size_t destsz)
+{
+	if (!r->cur) {
+		/* if it looks empty, forget the wake-ups before looking
+		 * again; whatever comes in after that pokes us anew */
+		if (!(r->cur = get(&r->full))) {
+			drain(r->notify[0]);
+			r->cur = get(&r->full);
+		}
+
+		if (!r->cur) {
+			errno = EAGAIN;
+			return -1;
+		}
+
+		/* the thread may be waiting for the room we just made.  It
+		 * raises the flag before it looks at `full` once more, we
+		 * check it after having made room, so either it sees the
+		 * room or we see the flag */
+		atomic_thread_fence(memory_order_seq_cst);
+		if (atomic_exchange(&r->wantroom, false))
+			poke(r->space[1]);
+		r->curoff = 0;
+	}
+
+	/* the last chunk stays put, so we keep saying so */
+	if (!r->cur->len) {
+		if (!r->cur->err)
+			return 0;
+		errno = r->cur->err;
+		return -1;
+	}
+
+	size_t n = r->cur->len - r->curoff;
+	if (n > destsz)
+		n = destsz;
+	memcpy(dest, r->cur->data + r->curoff, n);
+	r->curoff += n;
+
+	if (r->curoff == r->cur->len) {
+		if (!put(&r->free, r->cur))
+			free(r->cur);
+		r->cur = NULL;
+	}
+
+	return (ssize_t)n;
+}
+
+
+
+/* the thread: read into chunks and pass them on, until EOF, an error or
+ * reader_destroy() */
+static void *
+produce(void *arg)
+{
+	reader *r = arg;
+	struct chunk *c = NULL;
+	for (;;) {
+		if (!c && !(c = get(&r->free)))
+			c = xmalloc(sizeof *c);
+
+		if (!waitfor(r, r->fd))
+			break;
+
+		ssize_t n = xread(r->fd, c->data, sizeof c->data);
+		if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			continue;
+
+		c->len = n > 0 ? (size_t)n : 0;
+		c->err = n == -1 ? errno : 0;
+
+		/* room to spare is the common case; if there is none, the
+		 * user pokes r->space once it took one, see reader_read() */
+		bool stopped = false;
+		while (!put(&r->full, c)) {
+			drain(r->space[0]);
+			atomic_store(&r->wantroom, true);
+			atomic_thread_fence(memory_order_seq_cst);
+			if (put(&r->full, c)) {
+				atomic_store(&r->wantroom, false);
+				break;
+			}
+			if ((stopped = !waitfor(r, r->space[0])))
+				break;
+		}
+		if (stopped)
+			break;
+
+		poke(r->notify[1]);
+		c = NULL;
+		if (n <= 0)
+			return NULL;
+	}
+
+	free(c);
+	return NULL;
+}
+
+/* block until `fd` is readable; false if we're to stop instead */
+static bool
+waitfor(reader *r, int fd)
+{
+	struct pollfd pfds[2] = {
+		{ .fd = fd, .events = POLLIN },
+		{ .fd = r->stop[0], .events = POLLIN },
+	};
+
+	for (;;) {
+		if (poll(pfds, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			CE("poll");
+		}
+
+		if (pfds[1].revents)
+			return false;
+		if (pfds[0].revents)
+			return true;
+	}
+}
+
+static bool
+put(struct ring *q, struct chunk *c)
+{
+	size_t t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	if (t - atomic_load_explicit(&q->head, memory_order_acquire)
+	    == RINGSZ)
+		return false;
+
+	q->slot[t % RINGSZ] = c;
+	atomic_store_explicit(&q->tail, t + 1, memory_order_release);
+	return true;
+}
+
+static struct chunk *
+get(struct ring *q)
+{
+	size_t h = atomic_load_explicit(&q->head, memory_order_relaxed);
+	if (h == atomic_load_explicit(&q->tail, memory_order_acquire))
+		return NULL;
+
+	struct chunk *c = q->slot[h % RINGSZ];
+	atomic_store_explicit(&q->head, h + 1, memory_order_release);
+	return c;
+}
+
+static void
+mkpipe(int p[2])
+{
+	if (pipe(p) != 0)
+		CE("pipe");
+
+	for (size_t i = 0; i < 2; i++) {
+		setblocking(p[i], false);
+		fcntl(p[i], F_SETFD, FD_CLOEXEC);
+	}
+	return;
+}
+
+/* wake up whoever polls the other end; if it's full, it's awake */
+static void
+poke(int fd)
+{
+	if (write(fd, "", 1) == -1 && errno != EAGAIN)
+		EE("write");
+	return;
+}
+
+static void
+drain(int fd)
+{
+	char buf[64];
+	while (read(fd, buf, sizeof buf) > 0)
+		;
+	return;
+}
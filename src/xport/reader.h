@@ -0,0 +1,29 @@
+/* reader.h - Reads an fd on a thread of its own; for the transports
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef XPORT_READER_H
+#define XPORT_READER_H
+
+#include <stddef.h>
+
+#include <sys/types.h>
+
+/* A reader keeps reading `fd` into a chain of buffers while whoever
+ * reads from the reader is busy with what it got so far, e.g. parsing
+ * it.  The buffers go through a lock-free single-producer single-
+ * consumer queue; only one thread may use a reader at a time */
+typedef struct reader reader;
+
+/* Start reading `fd`, which has to stay open until reader_destroy() */
+reader *reader_new(int fd);
+void reader_destroy(reader *r);
+
+/* Readable when reader_read() will have something */
+int reader_fd(reader *r);
+
+/* Like xread(): the number of bytes read, 0 on EOF, -1 on error, or
+ * with errno EAGAIN if there's nothing for now */
+ssize_t reader_read(reader *r, void *dest, size_t destsz);
+
+#endif
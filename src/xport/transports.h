@@ -0,0 +1,8 @@
+/* transports.h - X-macro containing the known transports, default first
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+X(ssh)
+#if HAVE_LIBSSH
+X(libssh)
+#endif
@@ -0,0 +1,122 @@
+/* xport.c - Transport abstraction, byte streams to a switch; handled by sc
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_XPORT_XPORT
+
+#include "xport.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/common.h"
+#include "../common/log.h"
+
+
+/* Generate prototypes for all the attach functions that better exist... */
+#define X(IFNAME) \
+	void xport_ ## IFNAME ## _attach(struct xport_if *ifc);
+#include "transports.h"
+#undef X
+
+/* Generate a name -> attach function lookup table for by-name attaching */
+static struct xport_type {
+	char name[32];
+	void (*attach_fn)(struct xport_if *ifc);
+} s_transports[] = {
+#define X(IFNAME) {#IFNAME, xport_ ## IFNAME ## _attach},
+#include "transports.h"
+#undef X
+};
+
+/* A connection remembers who made it */
+struct xport {
+	const struct xport_if *ifc;
+	void *conn;
+};
+
+/* Attach points + call dispatch, one per transport; those not attached
+ * are all NULL */
+static struct xport_if s_ifs[COUNTOF(s_transports)];
+static size_t s_cur;
+
+static bool s_pipeline;
+
+
+void
+xport_attach(const char *name)
+{
+	for (size_t i = 0; i < COUNTOF(s_transports); i++) {
+		if (strcmp(s_transports[i].name, name) != 0)
+			continue;
+
+		if (!s_ifs[i].f_open)
+			s_transports[i].attach_fn(&s_ifs[i]);
+		s_cur = i;
+		return;
+	}
+
+	C("no such transport: '%s'", name);
+}
+
+void
+xport_pipeline(bool on)
+{
+	s_pipeline = on;
+	return;
+}
+
+bool
+xport_pipelined(void)
+{
+	return s_pipeline;
+}
+
+xport *
+xport_open(const char *host)
+{
+	if (!s_ifs[s_cur].f_open)
+		s_transports[s_cur].attach_fn(&s_ifs[s_cur]);
+
+	void *conn = s_ifs[s_cur].f_open(host);
+	if (!conn)
+		return NULL;
+
+	xport *x = xmalloc(sizeof *x);
+	x->ifc = &s_ifs[s_cur];
+	x->conn = conn;
+	return x;
+}
+
+void
+xport_close(xport *x)
+{
+	if (!x)
+		return;
+
+	x->ifc->f_close(x->conn);
+	free(x);
+	return;
+}
+
+int
+xport_fd(xport *x)
+{
+	return x->ifc->f_fd(x->conn);
+}
+
+ssize_t
+xport_read(xport *x, void *dest, size_t destsz)
+{
+	return x->ifc->f_read(x->conn, dest, destsz);
+}
+
+bool
+xport_write(xport *x, const char *data, size_t len)
+{
+	return x->ifc->f_write(x->conn, data, len);
+}
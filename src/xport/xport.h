@@ -0,0 +1,53 @@
+/* xport.h - Transport abstraction, byte streams to a switch; handled by sc
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef XPORT_XPORT_H
+#define XPORT_XPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <sys/types.h>
+
+/* The transport interface and call dispatch struct.  A transport hands
+ * out connections as opaque pointers */
+struct xport_if {
+	void   *(*f_open)(const char *host);
+	void    (*f_close)(void *conn);
+	int     (*f_fd)(void *conn);
+	ssize_t (*f_read)(void *conn, void *dest, size_t destsz);
+	bool    (*f_write)(void *conn, const char *data, size_t len);
+};
+
+typedef struct xport xport;
+
+/* Use transport `name` for connections opened from now on; panics if
+ * there is no such transport.  Until called, it's the first one listed
+ * in transports.h */
+void xport_attach(const char *name);
+
+/* Have connections opened from now on read on a thread of their own,
+ * overlapping reading with whatever is done with what was read (see
+ * reader.h).  Transports that can't do that ignore it */
+void xport_pipeline(bool on);
+bool xport_pipelined(void);
+
+/* Connect to `host`; NULL on failure.  Connecting may go on in the
+ * background, the first few xport_read()s may come up empty */
+xport *xport_open(const char *host);
+
+/* Hang up; NULL is fine */
+void xport_close(xport *x);
+
+/* For select(); readable when xport_read() may have something */
+int xport_fd(xport *x);
+
+/* Like xread(): the number of bytes read, 0 on EOF, -1 on error, or
+ * with errno EAGAIN if there's nothing for now */
+ssize_t xport_read(xport *x, void *dest, size_t destsz);
+
+/* Write it all, false on error (errno is set) */
+bool xport_write(xport *x, const char *data, size_t len);
+
+#endif
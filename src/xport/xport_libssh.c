@@ -0,0 +1,254 @@
+/* xport_libssh.c - Transport speaking ssh in-process, via libssh
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_XPORT_XPORT_LIBSSH
+
+#include "xport.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <libssh/libssh.h>
+
+#include "../common/common.h"
+#include "../common/log.h"
+
+/* where a connection is at; everything up to C_OPEN is done
+ * nonblockingly, a step per conn_read(), so that sessions that are
+ * still logging in don't hold up the others */
+#define C_CONNECT 0 /* TCP connect, key exchange */
+#define C_AUTH 1    /* public key authentication (keys, agent) */
+#define C_CHANNEL 2 /* opening a session channel */
+#define C_SHELL 3   /* asking for a shell on it */
+#define C_OPEN 4    /* talking to the switch */
+#define C_DEAD 5    /* failed, or the switch hung up */
+
+
+/* per-connection state */
+struct conn {
+	ssh_session ss;
+	ssh_channel ch;
+	int state;
+	int fd;
+};
+
+
+static void *conn_open(const char *host);
+static void conn_close(void *conn);
+static int conn_fd(void *conn);
+static ssize_t conn_read(void *conn, void *dest, size_t destsz);
+static bool conn_write(void *conn, const char *data, size_t len);
+static int establish(struct conn *c);
+static ssize_t die(struct conn *c, const char *what);
+
+
+void
+xport_libssh_attach(struct xport_if *ifc)
+{
+	/* attach pointers to the functions below to the interface
+	 * struct pointed to by `ifc` */
+	ifc->f_open = conn_open;
+	ifc->f_close = conn_close;
+	ifc->f_fd = conn_fd;
+	ifc->f_read = conn_read;
+	ifc->f_write = conn_write;
+	I("xport_libssh attached");
+	return;
+}
+
+
+
+/* `host` is what we'd hand ssh(1), [user@]host; ~/.ssh/config applies */
+static void *
+conn_open(const char *host)
+{
+	struct conn *c = xmalloc(sizeof *c);
+	c->ch = NULL;
+	c->state = C_CONNECT;
+	c->fd = -1;
+
+	if (!(c->ss = ssh_new())) {
+		E("ssh_new failed");
+		free(c);
+		return NULL;
+	}
+
+	if (ssh_options_set(c->ss, SSH_OPTIONS_HOST, host) != SSH_OK
+	    || ssh_options_parse_config(c->ss, NULL) != SSH_OK) {
+		E("bad host '%s': %s", host, ssh_get_error(c->ss));
+		ssh_free(c->ss);
+		free(c);
+		return NULL;
+	}
+
+	ssh_set_blocking(c->ss, 0);
+	D("connecting to '%s'", host);
+	if (establish(c) == -1) {
+		conn_close(c);
+		return NULL;
+	}
+
+	return c;
+}
+
+static void
+conn_close(void *conn)
+{
+	struct conn *c = conn;
+	if (c->ch) {
+		if (c->state == C_OPEN)
+			ssh_channel_close(c->ch);
+		ssh_channel_free(c->ch);
+	}
+	ssh_disconnect(c->ss);
+	ssh_free(c->ss);
+	free(c);
+	return;
+}
+
+static int
+conn_fd(void *conn)
+{
+	return ((struct conn *)conn)->fd;
+}
+
+static ssize_t
+conn_read(void *conn, void *dest, size_t destsz)
+{
+	struct conn *c = conn;
+	if (c->state == C_DEAD) {
+		errno = ECONNRESET;
+		return -1;
+	}
+
+	if (c->state != C_OPEN) {
+		if (establish(c) == -1)
+			return -1;
+		if (c->state != C_OPEN) {
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+
+	/* nobody wants to hear it, but it takes up window if left there */
+	char junk[512];
+	int n;
+	while ((n = ssh_channel_read_nonblocking(c->ch, junk, sizeof junk,
+	                                         1)) > 0)
+		D("switch said on stderr: '%.*s'", n, junk);
+
+	n = ssh_channel_read_nonblocking(c->ch, dest,
+	                                 destsz > 0x7fffffff ? 0x7fffffff
+	                                 : (uint32_t)destsz, 0);
+	if (n == SSH_ERROR)
+		return die(c, "read");
+	if (n > 0)
+		return n;
+
+	if (ssh_channel_is_eof(c->ch)) {
+		c->state = C_DEAD;
+		return 0;
+	}
+
+	errno = EAGAIN;
+	return -1;
+}
+
+/* writes are few and small, doing them blockingly is what the pipe
+ * transport does as well */
+static bool
+conn_write(void *conn, const char *data, size_t len)
+{
+	struct conn *c = conn;
+	if (c->state != C_OPEN) {
+		errno = ENOTCONN;
+		return false;
+	}
+
+	ssh_set_blocking(c->ss, 1);
+	int n = ssh_channel_write(c->ch, data, len);
+	ssh_set_blocking(c->ss, 0);
+
+	if (n == SSH_ERROR || (size_t)n != len) {
+		die(c, "write");
+		return false;
+	}
+
+	return true;
+}
+
+/* take the connection as far as we can without blocking; -1 if that
+ * failed */
+static int
+establish(struct conn *c)
+{
+	int r;
+	switch (c->state) {
+	case C_CONNECT:
+		r = ssh_connect(c->ss);
+		c->fd = ssh_get_fd(c->ss);
+		if (r == SSH_AGAIN)
+			return 0;
+		if (r != SSH_OK)
+			return die(c, "connect");
+
+		/* there's nobody to ask whether it's OK to trust a key
+		 * we haven't seen, so it isn't */
+		if (ssh_session_is_known_server(c->ss) != SSH_KNOWN_HOSTS_OK) {
+			E("host key unknown or changed, not trusting it");
+			c->state = C_DEAD;
+			errno = ECONNREFUSED;
+			return -1;
+		}
+
+		D("connected, authenticating");
+		c->state = C_AUTH;
+		/* fallthrough */
+	case C_AUTH:
+		r = ssh_userauth_publickey_auto(c->ss, NULL, NULL);
+		if (r == SSH_AUTH_AGAIN)
+			return 0;
+		if (r != SSH_AUTH_SUCCESS)
+			return die(c, "authenticate");
+
+		if (!(c->ch = ssh_channel_new(c->ss)))
+			return die(c, "create channel");
+		c->state = C_CHANNEL;
+		/* fallthrough */
+	case C_CHANNEL:
+		r = ssh_channel_open_session(c->ch);
+		if (r == SSH_AGAIN)
+			return 0;
+		if (r != SSH_OK)
+			return die(c, "open channel");
+
+		c->state = C_SHELL;
+		/* fallthrough */
+	case C_SHELL:
+		/* no pty, like ssh -T */
+		r = ssh_channel_request_shell(c->ch);
+		if (r == SSH_AGAIN)
+			return 0;
+		if (r != SSH_OK)
+			return die(c, "request shell");
+
+		D("logged in");
+		c->state = C_OPEN;
+	}
+
+	return 0;
+}
+
+static ssize_t
+die(struct conn *c, const char *what)
+{
+	E("could not %s: %s", what, ssh_get_error(c->ss));
+	c->state = C_DEAD;
+	errno = ECONNRESET;
+	return -1;
+}
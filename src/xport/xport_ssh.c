@@ -0,0 +1,104 @@
+/* xport_ssh.c - Transport running /usr/bin/ssh, talking to it via pipes
+ * swh - switch ssh front-end - (C) 2017, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+#define LOG_MOD MOD_XPORT_XPORT_SSH
+
+#include "xport.h"
+
+#include <stdlib.h>
+
+#include <unistd.h>
+
+#include "../common/common.h"
+#include "../common/log.h"
+#include "../spawn.h"
+#include "reader.h"
+
+
+/* per-connection state */
+struct conn {
+	pid_t pid;
+	int in, out, err; /* ssh's stdin, stdout, stderr */
+	reader *rd;       /* reads `out` if we're pipelined, else NULL */
+};
+
+
+static void *conn_open(const char *host);
+static void conn_close(void *conn);
+static int conn_fd(void *conn);
+static ssize_t conn_read(void *conn, void *dest, size_t destsz);
+static bool conn_write(void *conn, const char *data, size_t len);
+
+
+void
+xport_ssh_attach(struct xport_if *ifc)
+{
+	/* attach pointers to the functions below to the interface
+	 * struct pointed to by `ifc` */
+	ifc->f_open = conn_open;
+	ifc->f_close = conn_close;
+	ifc->f_fd = conn_fd;
+	ifc->f_read = conn_read;
+	ifc->f_write = conn_write;
+	I("xport_ssh attached");
+	return;
+}
+
+
+
+static void *
+conn_open(const char *host)
+{
+	struct conn *c = xmalloc(sizeof *c);
+	D("calling spawn to launch ssh");
+	c->pid = spawn_launch(host, &c->in, &c->out, &c->err);
+	if (c->pid == -1) {
+		E("could not spawn ssh");
+		free(c);
+		return NULL;
+	}
+
+	setblocking(c->out, false);
+	c->rd = xport_pipelined() ? reader_new(c->out) : NULL;
+	return c;
+}
+
+/* kills the ssh; it is reaped by spawn_operate() */
+static void
+conn_close(void *conn)
+{
+	struct conn *c = conn;
+	reader_destroy(c->rd);
+	spawn_kill(c->pid);
+	close(c->in);
+	close(c->out);
+	close(c->err);
+	free(c);
+	return;
+}
+
+static int
+conn_fd(void *conn)
+{
+	struct conn *c = conn;
+	return c->rd ? reader_fd(c->rd) : c->out;
+}
+
+static ssize_t
+conn_read(void *conn, void *dest, size_t destsz)
+{
+	struct conn *c = conn;
+	return c->rd ? reader_read(c->rd, dest, destsz)
+	             : xread(c->out, dest, destsz);
+}
+
+static bool
+conn_write(void *conn, const char *data, size_t len)
+{
+	return xwrite(((struct conn *)conn)->in, data, len);
+}